@@ -0,0 +1,222 @@
+#include "stdafx.h"
+#include "Batch.h"
+
+Batch::Batch() : walker(0), workerCount(), results(), taskCount() {
+	copier.SetMetrics(&metrics);
+}
+
+void Batch::ConfigureWorkers(unsigned workerCount, unsigned deviceLimit, bool isBackground) {
+	this->workerCount = workerCount;
+	pool.SetDefaultLimit(deviceLimit);
+	pool.SetBackground(isBackground);
+}
+
+// Scan, plan, and copy the entries, then do the same for those whose
+// copies the copier deferred until none are left.  The copier stops
+// deferring a file once it waited long enough.
+bool Batch::Run(std::vector<Entry> const& entries, std::vector<Result>& results) {
+	table.Build(entries);
+	scanned.assign(entries.size(), Scanned());
+	Result result = { Unchanged, 0 };
+	results.assign(entries.size(), result);
+	this->results = &results;
+	pool.Start(workerCount);
+	std::vector<size_t> indices(entries.size());
+	for(size_t i = 0; i < indices.size(); ++i) {
+		indices[i] = i;
+	}
+	while(!indices.empty()) {
+		Scan(indices);
+		std::vector<Step> steps;
+		Plan(indices, steps);
+		for(auto const& step : steps) {
+			std::vector<FileSystem::Device> devices;
+			for(size_t i : step.indices) {
+				for(unsigned side = 1; side <= 2; ++side) {
+					if(side == 1 ? scanned[i].found1 : scanned[i].found2) {
+						devices.push_back(side == 1 ? scanned[i].info1.device : scanned[i].info2.device);
+					}
+				}
+			}
+			Submit(std::bind(&Batch::Execute, this, step.indices), devices);
+		}
+		WaitForTasks();
+		indices.clear();
+		indices.swap(deferredIndices);
+		if(!indices.empty()) {
+			std::this_thread::sleep_for(copier.get_Options().stabilityTime);
+		}
+	}
+	pool.Stop();
+	copier.Flush();
+	this->results = nullptr;
+	for(auto const& result : results) {
+		if(result.status != Unchanged && result.status != Copied) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Get the state of the files of the entries, one folder per task.
+void Batch::Scan(std::vector<size_t> const& indices) {
+	std::map<tstring, std::vector<std::pair<size_t, unsigned>>> folders;
+	for(size_t i : indices) {
+		for(unsigned side = 1; side <= 2; ++side) {
+			tstring path = side == 1 ? table.get_Path1(i) : table.get_Path2(i);
+			folders[FileSystem::GetKey(FileSystem::GetFolder(path))].push_back(std::make_pair(i, side));
+		}
+	}
+	for(auto const& pair : folders) {
+		Submit(std::bind(&Batch::ScanFolder, this, pair.first, pair.second), std::vector<FileSystem::Device>());
+	}
+	WaitForTasks();
+	metrics.Add(Metrics::EntriesScanned, indices.size());
+}
+
+// Get the state of files in one folder on a worker thread, looking up only
+// those files.  Each entry's side belongs to one folder, so tasks never
+// share a slot.
+void Batch::ScanFolder(tstring const& folderPath, std::vector<std::pair<size_t, unsigned>> const& requests) {
+	std::vector<tstring> names;
+	names.reserve(requests.size());
+	for(auto const& request : requests) {
+		names.push_back(FileSystem::GetName(request.second == 1 ? table.get_Path1(request.first) : table.get_Path2(request.first)));
+	}
+	std::vector<FileSystem::Info> infos;
+	std::vector<bool> found;
+	FileSystem::GetInfos(folderPath, names, infos, found);
+	for(size_t k = 0; k < requests.size(); ++k) {
+		Scanned& s = scanned[requests[k].first];
+		(requests[k].second == 1 ? s.found1 : s.found2) = found[k];
+		(requests[k].second == 1 ? s.info1 : s.info2) = infos[k];
+	}
+}
+
+// Turn the entries whose files differ into steps, grouping one-way entries
+// by main file, and sort the steps by the device and path of their
+// sources.  Give each entry the state that makes synchronizing it copy
+// its newer file.
+void Batch::Plan(std::vector<size_t> const& indices, std::vector<Step>& steps) {
+	std::map<tstring, size_t> groups;
+	for(size_t i : indices) {
+		Scanned const& s = scanned[i];
+		if(!s.found1) {
+			(*results)[i].status = Missing;
+			continue;
+		} else if(table.IsTree(i)) {
+			Step step = { s.info1.device, table.get_Path1(i), std::vector<size_t>(1, i) };
+			steps.push_back(step);
+			continue;
+		}
+		table.SetInfo(i, 1, &s.info1);
+		table.SetInfo(i, 2, s.found2 ? &s.info2 : nullptr);
+		if(s.found2 && s.info1.lastWriteTime == s.info2.lastWriteTime) {
+			continue;
+		}
+		table.ForgetNewerTime(i);
+		if(table.IsTwoWay(i)) {
+			bool isReverse = table.get_LastWriteTime2(i) == 0 && s.found2;
+			Step step = { isReverse ? s.info2.device : s.info1.device, isReverse ? table.get_Path2(i) : table.get_Path1(i), std::vector<size_t>(1, i) };
+			steps.push_back(step);
+			continue;
+		}
+		tstring key = FileSystem::GetKey(table.get_Path1(i));
+		auto it = groups.find(key);
+		if(it == groups.end()) {
+			groups.insert(std::make_pair(key, steps.size()));
+			Step step = { s.info1.device, table.get_Path1(i), std::vector<size_t>(1, i) };
+			steps.push_back(step);
+		} else {
+			steps[it->second].indices.push_back(i);
+		}
+	}
+	std::sort(steps.begin(), steps.end());
+}
+
+// Synchronize the entries of a step on a worker thread.
+void Batch::Execute(std::vector<size_t> const& indices) {
+	metrics.Increment(Metrics::Synchronizations);
+	if(table.IsTree(indices.front())) {
+		ExecuteTree(indices.front());
+		return;
+	}
+	std::vector<EntryTable::State> states;
+	for(size_t i : indices) {
+		states.push_back(table.GetState(i));
+	}
+	std::vector<tstring> deferredPaths;
+	std::vector<bool> copied;
+	if(indices.size() == 1) {
+		copied.assign(1, table.Synchronize(indices.front(), states.front(), copier, deferredPaths, nullptr));
+	} else {
+		table.SynchronizeGroup(indices, states, copier, deferredPaths, nullptr, copied);
+	}
+	for(size_t k = 0; k < indices.size(); ++k) {
+		Finish(indices[k], copied[k], !deferredPaths.empty());
+	}
+}
+
+// Synchronize a whole tree, then compare it again to find the files that
+// still differ.
+void Batch::ExecuteTree(size_t i) {
+	std::vector<tstring> folderPaths, deferredPaths, filePaths;
+	unsigned copyCount = table.SynchronizeTree(i, std::vector<tstring>(1, tstring()), copier, walker, folderPaths, deferredPaths);
+	if(deferredPaths.empty()) {
+		folderPaths.clear();
+		walker.Compare(table.get_Path1(i), table.get_Path2(i), tstring(), table.IsTwoWay(i), filePaths, folderPaths);
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	Result& result = (*results)[i];
+	result.copyCount += copyCount;
+	if(!deferredPaths.empty()) {
+		deferredIndices.push_back(i);
+	} else {
+		result.status = !filePaths.empty() ? Failed : result.copyCount > 0 ? Copied : Unchanged;
+	}
+}
+
+// Record the result of a file entry once its files have the same last
+// write time, or try it again if its copy was deferred.
+void Batch::Finish(size_t i, bool copied, bool isDeferred) {
+	FileSystem::Info info1, info2;
+	bool isSame = FileSystem::GetInfo(table.get_Path1(i), info1) && FileSystem::GetInfo(table.get_Path2(i), info2)
+		&& info1.lastWriteTime == info2.lastWriteTime;
+	std::lock_guard<std::mutex> lock(mutex);
+	Result& result = (*results)[i];
+	if(copied) {
+		++result.copyCount;
+	}
+	if(isSame) {
+		result.status = result.copyCount > 0 ? Copied : Unchanged;
+	} else if(isDeferred) {
+		deferredIndices.push_back(i);
+	} else {
+		result.status = Failed;
+	}
+}
+
+void Batch::Submit(WorkerPool::Task const& task, std::vector<FileSystem::Device> const& devices) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		++taskCount;
+	}
+	pool.Submit([this, task] {
+		task();
+		std::lock_guard<std::mutex> lock(mutex);
+		if(--taskCount == 0) {
+			condition.notify_all();
+		}
+	}, devices);
+}
+
+void Batch::WaitForTasks() {
+	std::unique_lock<std::mutex> lock(mutex);
+	condition.wait(lock, [this] { return taskCount == 0; });
+}
+
+char const* Batch::GetStatusName(Status status) {
+	static char const* const names[] = { "unchanged", "copied", "missing", "failed" };
+	static_assert(_countof(names) == StatusCount, "missing status name");
+	return names[status];
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "Copier.h"
+#include "Entry.h"
+#include "EntryTable.h"
+#include "Metrics.h"
+#include "TreeWalker.h"
+#include "WorkerPool.h"
+
+// A batch synchronizes a set of entries once, without watching them, for
+// scripts and scheduled jobs.  It scans the files of all entries in
+// parallel, one folder at a time, then plans the copies of the entries
+// that differ.  The plan orders them by device and path so the workers,
+// one at a time on a spinning disk, read each device in order, and it
+// copies a main file shared by several one-way entries with one read.
+// Copies of files still being written wait and try again.
+class Batch
+{
+public:
+	// Unchanged entries already matched.  Missing entries lack their main
+	// file.  Failed entries still differ after their copies.
+	enum Status { Unchanged, Copied, Missing, Failed, StatusCount };
+
+	struct Result
+	{
+		Status status;
+
+		// This is the number of files copied.
+		unsigned copyCount;
+	};
+
+	Batch();
+
+	// Set the number of copy workers, zero for one per processor, the
+	// number of concurrent copies for each non-rotational device, and
+	// whether their I/O has the lowest priority.
+	void ConfigureWorkers(unsigned workerCount, unsigned deviceLimit, bool isBackground);
+	void ConfigureCopying(Copier::Options const& options) { copier.Configure(options); }
+
+	// Synchronize the entries and get the result of each.  Return whether
+	// all of them are now the same on both sides.
+	bool Run(std::vector<Entry> const& entries, std::vector<Result>& results);
+
+	Copier::Statistics get_CopyStatistics() const { return copier.get_Statistics(); }
+	Metrics const& get_Metrics() const { return metrics; }
+
+	static char const* GetStatusName(Status status);
+
+private:
+	// This is the state of the files of an entry as the scan found it.
+	struct Scanned
+	{
+		bool found1, found2;
+		FileSystem::Info info1, info2;
+	};
+
+	// A step copies one entry or, for a group of one-way entries sharing a
+	// main file, all of them.  The plan sorts steps by their keys.
+	struct Step
+	{
+		FileSystem::Device device;
+		tstring path;
+		std::vector<size_t> indices;
+
+		bool operator<(Step const& that) const { return device != that.device ? device < that.device : path < that.path; }
+	};
+
+	EntryTable table;
+	TreeWalker walker;
+	Copier copier;
+	Metrics metrics;
+	unsigned workerCount;
+	std::vector<Scanned> scanned;
+	std::vector<Result>* results;
+
+	// The mutex protects these.
+	std::mutex mutex;
+	std::condition_variable condition;
+	size_t taskCount;
+	std::vector<size_t> deferredIndices;
+
+	// Destroy the pool first so no worker outlives the rest.
+	WorkerPool pool;
+
+	void Scan(std::vector<size_t> const& indices);
+	void ScanFolder(tstring const& folderPath, std::vector<std::pair<size_t, unsigned>> const& requests);
+	void Plan(std::vector<size_t> const& indices, std::vector<Step>& steps);
+	void Execute(std::vector<size_t> const& indices);
+	void ExecuteTree(size_t i);
+	void Finish(size_t i, bool copied, bool isDeferred);
+	void Submit(WorkerPool::Task const& task, std::vector<FileSystem::Device> const& devices);
+	void WaitForTasks();
+
+	Batch(Batch const&); // undefined
+	Batch& operator=(Batch const&); // undefined
+};
@@ -0,0 +1,69 @@
+#include "stdafx.h"
+#include "Benchmark.h"
+#include "FileSystem.h"
+#include <ftw.h>
+#include <sys/resource.h>
+
+bool Benchmark::MakeTemporaryFolder(tstring const& parentPath, char const* name, tstring& folderPath) {
+	folderPath = FileSystem::Combine(parentPath, tstring(name) + ".XXXXXX");
+	if(mkdtemp(&folderPath[0]) == nullptr) {
+		perror(folderPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+static int RemoveItem(char const* path, struct stat const* /*st*/, int /*type*/, struct FTW* /*ftw*/) {
+	return remove(path);
+}
+
+void Benchmark::RemoveFolder(tstring const& folderPath) {
+	nftw(folderPath.c_str(), RemoveItem, 64, FTW_DEPTH | FTW_PHYS);
+}
+
+bool Benchmark::WriteFile(tstring const& path, void const* data, size_t size) {
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if(fd < 0) {
+		return false;
+	}
+	char const* p = static_cast<char const*>(data);
+	while(size > 0) {
+		ssize_t n = write(fd, p, size);
+		if(n <= 0) {
+			close(fd);
+			return false;
+		}
+		p += n;
+		size -= n;
+	}
+	return close(fd) == 0;
+}
+
+unsigned long long Benchmark::GetIoCallCount(bool isThreadOnly) {
+	FILE* file = fopen(isThreadOnly ? "/proc/thread-self/io" : "/proc/self/io", "r");
+	if(file == nullptr) {
+		return 0;
+	}
+	unsigned long long count = 0, value;
+	char name[32];
+	while(fscanf(file, "%31[^:]: %llu\n", name, &value) == 2) {
+		if(strcmp(name, "syscr") == 0 || strcmp(name, "syscw") == 0) {
+			count += value;
+		}
+	}
+	fclose(file);
+	return count;
+}
+
+long Benchmark::GetPeakResidentSize() {
+	rusage usage;
+	return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+}
+
+double Benchmark::GetPercentile(std::vector<double> const& sortedValues, double fraction) {
+	if(sortedValues.empty()) {
+		return 0;
+	}
+	size_t i = static_cast<size_t>(fraction * (sortedValues.size() - 1) + 0.5);
+	return sortedValues[i];
+}
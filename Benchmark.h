@@ -0,0 +1,27 @@
+#pragma once
+
+// These help the benchmarks make their workloads and measure the process.
+// They are for Linux only.
+namespace Benchmark
+{
+	typedef std::chrono::steady_clock Clock;
+
+	// Make a new folder with a unique name in the parent folder.
+	bool MakeTemporaryFolder(tstring const& parentPath, char const* name, tstring& folderPath);
+
+	// Remove a folder and everything in it.
+	void RemoveFolder(tstring const& folderPath);
+
+	// Write a file with the given contents, replacing any old ones.
+	bool WriteFile(tstring const& path, void const* data, size_t size);
+
+	// Get the number of read and write system calls, including those of
+	// threads that exited, of the process or of the calling thread.
+	unsigned long long GetIoCallCount(bool isThreadOnly);
+
+	// Get the largest resident set size of the process so far in kilobytes.
+	long GetPeakResidentSize();
+
+	// Get a percentile of sorted values.
+	double GetPercentile(std::vector<double> const& sortedValues, double fraction);
+}
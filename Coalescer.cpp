@@ -0,0 +1,104 @@
+#include "stdafx.h"
+#include "Coalescer.h"
+
+void Coalescer::Configure(Clock::duration quietTime, Clock::duration maximumDelay) {
+	this->quietTime = quietTime;
+	this->maximumDelay = std::max(quietTime, maximumDelay);
+}
+
+Coalescer::Clock::time_point Coalescer::GetDeadline(Pending const& pending) const {
+	return std::max(pending.holdTime, std::min(pending.lastTime + quietTime, pending.firstTime + maximumDelay));
+}
+
+void Coalescer::Add(Watcher::Event const& event, Clock::time_point now) {
+	++eventCount;
+	bool isOverflow = event.action == Watcher::Overflow;
+	Key key(event.folderPath, isOverflow ? tstring() : event.name);
+	auto it = pendingEvents.find(key);
+	if(it == pendingEvents.end() && !isOverflow) {
+		// A pending overflow event of the folder covers this one.
+		it = pendingEvents.find(Key(event.folderPath, tstring()));
+		if(it == pendingEvents.end() && ++folderCounts[event.folderPath] > folderLimit) {
+			Collapse(event.folderPath, now);
+			return;
+		}
+	}
+	if(it == pendingEvents.end()) {
+		Pending pending = { event, now, now, Clock::time_point() };
+		pendingEvents.insert(std::make_pair(key, pending));
+		deadlines.push(Deadline(GetDeadline(pending), key));
+	} else {
+		// Keep the first time so the maximum delay applies.  The existing
+		// deadline is now early; TakeReady will push the new one.
+		if(it->second.event.action != Watcher::Overflow) {
+			it->second.event.action = event.action;
+		}
+		it->second.lastTime = now;
+	}
+}
+
+void Coalescer::Hold(Watcher::Event const& event, Clock::time_point time, Clock::time_point now) {
+	Key key(event.folderPath, event.name);
+	if(pendingEvents.find(key) != pendingEvents.end() || pendingEvents.find(Key(event.folderPath, tstring())) != pendingEvents.end()) {
+		return;
+	}
+	++folderCounts[event.folderPath];
+	Pending pending = { event, now, now, time };
+	pendingEvents.insert(std::make_pair(key, pending));
+	deadlines.push(Deadline(GetDeadline(pending), key));
+}
+
+// Replace the pending events of a folder with an overflow event.  Their
+// deadlines become stale.
+void Coalescer::Collapse(tstring const& folderPath, Clock::time_point now) {
+	Clock::time_point firstTime = now;
+	auto it = pendingEvents.lower_bound(Key(folderPath, tstring()));
+	while(it != pendingEvents.end() && it->first.first == folderPath) {
+		firstTime = std::min(firstTime, it->second.firstTime);
+		it = pendingEvents.erase(it);
+	}
+	folderCounts.erase(folderPath);
+	Pending pending = { Watcher::Event{ folderPath, tstring(), Watcher::Overflow }, firstTime, now, Clock::time_point() };
+	Key key(folderPath, tstring());
+	pendingEvents.insert(std::make_pair(key, pending));
+	deadlines.push(Deadline(GetDeadline(pending), key));
+}
+
+void Coalescer::TakeReady(Clock::time_point now, std::vector<Watcher::Event>& events, std::vector<Clock::time_point>& firstTimes) {
+	while(!deadlines.empty() && deadlines.top().first <= now) {
+		Key key = deadlines.top().second;
+		deadlines.pop();
+		auto it = pendingEvents.find(key);
+		if(it == pendingEvents.end()) {
+			continue;
+		}
+		Clock::time_point deadline = GetDeadline(it->second);
+		if(deadline > now) {
+			deadlines.push(Deadline(deadline, key));
+		} else {
+			events.push_back(it->second.event);
+			firstTimes.push_back(it->second.firstTime);
+			if(it->second.event.action != Watcher::Overflow) {
+				auto count = folderCounts.find(key.first);
+				if(count != folderCounts.end() && --count->second == 0) {
+					folderCounts.erase(count);
+				}
+			}
+			pendingEvents.erase(it);
+			++releaseCount;
+		}
+	}
+}
+
+int Coalescer::GetTimeout(Clock::time_point now) const {
+	if(deadlines.empty()) {
+		return Watcher::Infinite;
+	} else if(deadlines.top().first <= now) {
+		return 0;
+	}
+
+	// Round up so the wait does not end just before the deadline.
+	auto duration = deadlines.top().first - now;
+	auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(duration + std::chrono::milliseconds(1) - Clock::duration(1));
+	return static_cast<int>(std::min<long long>(milliseconds.count(), INT_MAX));
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Watcher.h"
+
+// A coalescer holds change events until their files have been quiet for a
+// while so a burst of events for one file yields one synchronization.  It
+// releases a file that keeps changing after a maximum delay.  A folder with
+// too many changed files collapses into one overflow event, which compares
+// the folder again, so a burst of any size holds bounded memory.
+class Coalescer
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	Coalescer() : quietTime(std::chrono::milliseconds(200)), maximumDelay(std::chrono::seconds(2)), folderLimit(1024), eventCount(), releaseCount() {}
+	void Configure(Clock::duration quietTime, Clock::duration maximumDelay);
+	void Add(Watcher::Event const& event, Clock::time_point now);
+
+	// Hold an event until a time, as for a file the workers must look at
+	// again later.  A pending event for the file stays as it is.
+	void Hold(Watcher::Event const& event, Clock::time_point time, Clock::time_point now);
+
+	// Append the events whose files are quiet or have waited long enough,
+	// and the times their first events arrived.
+	void TakeReady(Clock::time_point now, std::vector<Watcher::Event>& events, std::vector<Clock::time_point>& firstTimes);
+
+	// Get the milliseconds until the next event is ready, or
+	// Watcher::Infinite if there are none.
+	int GetTimeout(Clock::time_point now) const;
+
+	// Get the number of events added and the number released.  The
+	// difference is the number of synchronizations avoided.  Other threads
+	// may call these.
+	unsigned long long get_EventCount() const { return eventCount; }
+	unsigned long long get_ReleaseCount() const { return releaseCount; }
+
+private:
+	// The key is the folder path and file name.  The name is empty for
+	// overflow events.
+	typedef std::pair<tstring, tstring> Key;
+	struct Pending
+	{
+		Watcher::Event event;
+		Clock::time_point firstTime, lastTime, holdTime;
+	};
+	typedef std::pair<Clock::time_point, Key> Deadline;
+
+	Clock::duration quietTime, maximumDelay;
+	std::map<Key, Pending> pendingEvents;
+
+	// This counts the pending file events of each folder.
+	std::unordered_map<tstring, size_t> folderCounts;
+	size_t folderLimit;
+
+	// This holds a deadline for each pending event, ordered earliest first.
+	// A deadline may be stale if more events arrived; TakeReady rechecks it.
+	std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> deadlines;
+	std::atomic<unsigned long long> eventCount, releaseCount;
+
+	Clock::time_point GetDeadline(Pending const& pending) const;
+	void Collapse(tstring const& folderPath, Clock::time_point now);
+};
@@ -0,0 +1,521 @@
+#include "stdafx.h"
+#include "Copier.h"
+#include "Pipeline.h"
+
+static std::chrono::steady_clock::duration const flushInterval = std::chrono::minutes(5);
+
+Copier::Copier() : metrics(), echoFilter(), fullCopyCount(), deltaCopyCount(), streamedCopyCount(), unchangedCount(), bytesCompared(), bytesWritten(), bytesHashed() {
+	options.deltaThreshold = 64ull << 20;
+	options.blockSize = 64 << 10;
+	options.streamThreshold = 64ull << 20;
+	options.streamBufferSize = 1 << 20;
+	options.streamDepth = 4;
+	options.directIo = false;
+	options.compareContents = false;
+	options.stabilityThreshold = 16ull << 20;
+	options.stabilityTime = std::chrono::seconds(1);
+	options.maximumStabilityWait = std::chrono::minutes(5);
+	options.limit.bytesPerSecond = options.limit.operationsPerSecond = 0;
+	nextFlushTime = std::chrono::steady_clock::now() + flushInterval;
+	for(auto& methodCount : methodCounts) {
+		methodCount = 0;
+	}
+}
+
+void Copier::Configure(Options const& options) {
+	this->options = options;
+	throttle.Configure(options.limit.bytesPerSecond, options.limit.operationsPerSecond);
+	deviceThrottles.clear();
+	for(auto const& pair : options.deviceLimits) {
+		std::unique_ptr<Throttle>& deviceThrottle = deviceThrottles[pair.first];
+		deviceThrottle.reset(new Throttle);
+		deviceThrottle->Configure(pair.second.bytesPerSecond, pair.second.operationsPerSecond);
+	}
+	if(options.compareContents && !options.hashCachePath.empty()) {
+		hashCache.Load(options.hashCachePath);
+	}
+	nextFlushTime = std::chrono::steady_clock::now() + flushInterval;
+}
+
+bool Copier::Flush() {
+	return !options.compareContents || options.hashCachePath.empty() || hashCache.Save(options.hashCachePath);
+}
+
+// Save the hash cache if it is time to, on the thread of the first copy
+// that finds it is.
+void Copier::FlushPeriodically() {
+	if(!options.compareContents || options.hashCachePath.empty()) {
+		return;
+	}
+	auto now = std::chrono::steady_clock::now();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if(now < nextFlushTime) {
+			return;
+		}
+		nextFlushTime = now + flushInterval;
+	}
+	Flush();
+}
+
+// Determine whether the destination, or its folder if it does not exist,
+// is on a different device than the source.
+static bool IsOnOtherDevice(FileSystem::Info const& sourceInfo, tstring const& destinationPath) {
+	FileSystem::Info info;
+	if(!FileSystem::GetInfo(destinationPath, info) && !FileSystem::GetInfo(FileSystem::GetFolder(destinationPath), info)) {
+		return false;
+	}
+	return info.device != sourceInfo.device;
+}
+
+Copier::Result Copier::Copy(tstring const& sourcePath, tstring const& destinationPath, std::atomic<bool> const* isCancelled) {
+	if(echoFilter) {
+		echoFilter->Begin(destinationPath);
+	}
+	auto startTime = std::chrono::steady_clock::now();
+	FileSystem::Info sourceInfo = FileSystem::Info();
+	Result result = Failed;
+	if(FileSystem::GetInfo(sourcePath, sourceInfo)) {
+		if(options.stabilityThreshold > 0 && sourceInfo.size >= options.stabilityThreshold && !IsStable(sourcePath, sourceInfo)) {
+			result = Deferred;
+		} else {
+			result = Transfer(sourcePath, sourceInfo, destinationPath, isCancelled);
+		}
+	}
+	Finish(destinationPath, result, sourceInfo.size, startTime);
+	FlushPeriodically();
+	return result;
+}
+
+void Copier::Copy(tstring const& sourcePath, std::vector<tstring> const& destinationPaths, std::atomic<bool> const* isCancelled,
+	std::vector<Result>& results) {
+	if(destinationPaths.size() == 1) {
+		results.assign(1, Copy(sourcePath, destinationPaths.front(), isCancelled));
+		return;
+	}
+	if(echoFilter) {
+		for(auto const& destinationPath : destinationPaths) {
+			echoFilter->Begin(destinationPath);
+		}
+	}
+	auto startTime = std::chrono::steady_clock::now();
+	results.assign(destinationPaths.size(), Failed);
+	FileSystem::Info sourceInfo = FileSystem::Info();
+	if(!FileSystem::GetInfo(sourcePath, sourceInfo)) {
+		for(auto const& destinationPath : destinationPaths) {
+			Finish(destinationPath, Failed, 0, startTime);
+		}
+		return;
+	} else if(options.stabilityThreshold > 0 && sourceInfo.size >= options.stabilityThreshold && !IsStable(sourcePath, sourceInfo)) {
+		for(auto const& destinationPath : destinationPaths) {
+			Finish(destinationPath, Deferred, sourceInfo.size, startTime);
+		}
+		return;
+	}
+
+	// Fan out to the destinations that would each get a streamed copy
+	// anyway if there are several.
+	std::vector<size_t> positions;
+	std::vector<tstring> streamedPaths;
+	for(size_t k = 0; k < destinationPaths.size(); ++k) {
+		if(WouldStream(sourceInfo, destinationPaths[k])) {
+			positions.push_back(k);
+			streamedPaths.push_back(destinationPaths[k]);
+		}
+	}
+	std::vector<bool> isDone(destinationPaths.size());
+	if(streamedPaths.size() >= 2) {
+		std::vector<Result> streamedResults;
+		CopyFannedOut(sourcePath, streamedPaths, sourceInfo, isCancelled, streamedResults);
+		for(size_t j = 0; j < positions.size(); ++j) {
+			results[positions[j]] = streamedResults[j];
+			isDone[positions[j]] = true;
+			Finish(streamedPaths[j], streamedResults[j], sourceInfo.size, startTime);
+		}
+	}
+	for(size_t k = 0; k < destinationPaths.size(); ++k) {
+		if(!isDone[k]) {
+			startTime = std::chrono::steady_clock::now();
+			results[k] = Transfer(sourcePath, sourceInfo, destinationPaths[k], isCancelled);
+			Finish(destinationPaths[k], results[k], sourceInfo.size, startTime);
+		}
+	}
+	FlushPeriodically();
+}
+
+// Tell the echo filter and the metrics about a finished copy.
+void Copier::Finish(tstring const& destinationPath, Result result, unsigned long long size, std::chrono::steady_clock::time_point startTime) {
+	auto endTime = std::chrono::steady_clock::now();
+	if(echoFilter) {
+		FileSystem::Info info;
+		echoFilter->End(destinationPath, result != Failed && FileSystem::GetInfo(destinationPath, info) ? &info : nullptr, endTime);
+	}
+	if(!metrics) {
+		return;
+	}
+	metrics->Record(Metrics::Copy, endTime - startTime);
+	if(result == Deferred) {
+		metrics->Increment(Metrics::Deferrals);
+	} else if(result == Cancelled) {
+		metrics->Increment(Metrics::Cancellations);
+	} else if(result == Failed) {
+		metrics->Increment(Metrics::CopyFailures);
+	} else if(result == Copied) {
+		metrics->Increment(Metrics::Copies);
+		metrics->Add(Metrics::BytesCopied, size);
+	}
+}
+
+// Append the throttle of a device if it has one.
+void Copier::GetThrottles(FileSystem::Device device, std::vector<Throttle*>& throttles) {
+	auto it = deviceThrottles.find(device);
+	if(it != deviceThrottles.end() && it->second->IsEnabled()) {
+		throttles.push_back(it->second.get());
+	}
+}
+
+// Get the throttles a copy passes, once for each destination it writes
+// through them: the global one and those of the devices of the
+// destinations or, for new files, their folders.  The source's device
+// counts once more unless a destination shares it.
+void Copier::GetThrottles(FileSystem::Info const& sourceInfo, std::vector<tstring> const& destinationPaths, std::vector<Throttle*>& throttles) {
+	throttles.clear();
+	if(throttle.IsEnabled()) {
+		throttles.assign(destinationPaths.size(), &throttle);
+	}
+	if(deviceThrottles.empty()) {
+		return;
+	}
+	bool isSourceShared = false;
+	for(auto const& destinationPath : destinationPaths) {
+		FileSystem::Info info;
+		if(FileSystem::GetInfo(destinationPath, info) || FileSystem::GetInfo(FileSystem::GetFolder(destinationPath), info)) {
+			isSourceShared = isSourceShared || info.device == sourceInfo.device;
+			GetThrottles(info.device, throttles);
+		}
+	}
+	if(!isSourceShared) {
+		GetThrottles(sourceInfo.device, throttles);
+	}
+}
+
+// Make the progress of a copy that takes the tokens of each chunk from the
+// throttles, as often as each appears, and waits out their debts, and that stops once the flag, if
+// given, is set.  Wait in short steps so a cancellation ends the wait.
+FileSystem::Progress Copier::Pace(std::vector<Throttle*> const& throttles, std::atomic<bool> const* isCancelled) {
+	if(throttles.empty()) {
+		if(!isCancelled) {
+			return FileSystem::Progress();
+		}
+		return [isCancelled](unsigned long long) { return !*isCancelled; };
+	}
+	Metrics* metrics = this->metrics;
+	return [throttles, isCancelled, metrics](unsigned long long size) {
+		auto now = Throttle::Clock::now();
+		Throttle::Clock::duration wait = Throttle::Clock::duration::zero();
+		for(Throttle* throttle : throttles) {
+			wait = std::max(wait, throttle->Take(size, 1, now));
+		}
+		auto startTime = now, endTime = now + wait;
+		while(!(isCancelled && *isCancelled) && now < endTime) {
+			std::this_thread::sleep_for(std::min<Throttle::Clock::duration>(endTime - now, std::chrono::milliseconds(100)));
+			now = Throttle::Clock::now();
+		}
+
+		// Count the time slept, which a cancellation cuts short.
+		if(metrics && now > startTime) {
+			metrics->Add(Metrics::ThrottledTime, std::chrono::duration_cast<std::chrono::microseconds>(now - startTime).count());
+		}
+		return !(isCancelled && *isCancelled);
+	};
+}
+
+// Determine whether a large file is done changing and forget its probes
+// if so.  A file that waited long enough counts as stable.
+bool Copier::IsStable(tstring const& filePath, FileSystem::Info const& info) {
+	bool hasWriters;
+	bool isKnown = FileSystem::HasWriters(filePath, hasWriters);
+	auto now = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = probes.find(filePath);
+	bool isStable;
+	if(it == probes.end()) {
+		isStable = isKnown && !hasWriters;
+	} else {
+		isStable = (isKnown ? !hasWriters : it->second.size == info.size && it->second.lastWriteTime == info.lastWriteTime)
+			|| now - it->second.firstTime >= options.maximumStabilityWait;
+	}
+	if(isStable) {
+		if(it != probes.end()) {
+			probes.erase(it);
+		}
+		return true;
+	}
+	if(it == probes.end()) {
+		// Forget the probes of files that went away while waiting.
+		for(auto old = probes.begin(); old != probes.end();) {
+			if(now - old->second.firstTime >= 2 * options.maximumStabilityWait) {
+				old = probes.erase(old);
+			} else {
+				++old;
+			}
+		}
+		Probe probe = { now, info.size, info.lastWriteTime };
+		probes.insert(std::make_pair(filePath, probe));
+	} else {
+		it->second.size = info.size;
+		it->second.lastWriteTime = info.lastWriteTime;
+	}
+	return false;
+}
+
+// Determine whether a copy to the destination would stream the whole
+// source: it is large, neither a delta copy nor a comparison of hashes
+// applies, and the destination is on another device so it cannot be a
+// clone either.
+bool Copier::WouldStream(FileSystem::Info const& sourceInfo, tstring const& destinationPath) {
+	FileSystem::Info destinationInfo;
+	if(FileSystem::GetInfo(destinationPath, destinationInfo) && ((options.deltaThreshold > 0 && sourceInfo.size >= options.deltaThreshold)
+		|| (options.compareContents && sourceInfo.size == destinationInfo.size))) {
+		return false;
+	}
+	return options.streamThreshold > 0 && sourceInfo.size >= options.streamThreshold && IsOnOtherDevice(sourceInfo, destinationPath);
+}
+
+// Copy a stable file.
+Copier::Result Copier::Transfer(tstring const& sourcePath, FileSystem::Info const& sourceInfo, tstring const& destinationPath,
+	std::atomic<bool> const* isCancelled) {
+	FileSystem::Info destinationInfo;
+	bool destinationExists = FileSystem::GetInfo(destinationPath, destinationInfo);
+	std::vector<Throttle*> throttles;
+	GetThrottles(sourceInfo, std::vector<tstring>(1, destinationPath), throttles);
+	FileSystem::Progress progress = Pace(throttles, isCancelled);
+	unsigned long long sourceHash = 0;
+	if(options.compareContents && destinationExists && sourceInfo.size == destinationInfo.size
+		&& HaveSameContents(sourcePath, sourceInfo, destinationPath, destinationInfo, sourceHash)) {
+		// Only the time differs.  Make it match as a copy would.
+		FileSystem::File destination;
+		if(destination.Open(destinationPath, FileSystem::File::ReadWrite) && destination.SetTime(sourceInfo.lastWriteTime) && destination.GetInfo(destinationInfo)) {
+			if(!destination.Close()) {
+				return Failed;
+			}
+			hashCache.SetHash(destinationPath, destinationInfo, sourceHash);
+			++unchangedCount;
+			if(options.report) {
+				options.report(sourcePath, destinationPath, "unchanged");
+			}
+			return Unchanged;
+		}
+	}
+
+	bool copied;
+	char const* methodName;
+	if(options.deltaThreshold > 0 && sourceInfo.size >= options.deltaThreshold && destinationExists) {
+		copied = CopyDelta(sourcePath, destinationPath, sourceInfo, destinationInfo.size, progress);
+		methodName = "delta";
+	} else if(options.streamThreshold > 0 && sourceInfo.size >= options.streamThreshold && IsOnOtherDevice(sourceInfo, destinationPath)) {
+		copied = CopyStreamed(sourcePath, destinationPath, sourceInfo, progress);
+		methodName = options.directIo ? "streamed direct" : "streamed";
+	} else {
+		FileSystem::CopyMethod method = FileSystem::Native;
+		tstring temporaryPath = BeginTemporary(destinationPath);
+		copied = EndTemporary(temporaryPath, destinationPath, FileSystem::Copy(sourcePath, temporaryPath, false, method, progress));
+		methodName = GetMethodName(method);
+		if(copied) {
+			++fullCopyCount;
+			++methodCounts[method];
+			bytesWritten += sourceInfo.size;
+		}
+	}
+	if(!copied) {
+		return isCancelled && *isCancelled ? Cancelled : Failed;
+	}
+	if(options.report) {
+		options.report(sourcePath, destinationPath, methodName);
+	}
+
+	// The destination now has the source's hash if the source did not
+	// change during the copy.
+	if(sourceHash != 0 && FileSystem::GetInfo(destinationPath, destinationInfo) && destinationInfo.lastWriteTime == sourceInfo.lastWriteTime
+		&& destinationInfo.size == sourceInfo.size) {
+		hashCache.SetHash(destinationPath, destinationInfo, sourceHash);
+	}
+	return Copied;
+}
+
+// Compare the hashes of two files of the same size.  Get the source's hash
+// even if they differ so the caller can remember it for the destination.
+bool Copier::HaveSameContents(tstring const& sourcePath, FileSystem::Info const& sourceInfo, tstring const& destinationPath,
+	FileSystem::Info const& destinationInfo, unsigned long long& sourceHash) {
+	unsigned long long destinationHash;
+	bool computed;
+	if(!hashCache.GetHash(sourcePath, sourceInfo, sourceHash, computed)) {
+		sourceHash = 0;
+		return false;
+	}
+	if(computed) {
+		bytesHashed += sourceInfo.size;
+	}
+	if(!hashCache.GetHash(destinationPath, destinationInfo, destinationHash, computed)) {
+		return false;
+	}
+	if(computed) {
+		bytesHashed += destinationInfo.size;
+	}
+	return sourceHash == destinationHash;
+}
+
+// Start a full copy, which writes a temporary file beside the destination.
+tstring Copier::BeginTemporary(tstring const& destinationPath) {
+	tstring temporaryPath = FileSystem::GetTemporaryPath(destinationPath);
+	if(echoFilter) {
+		echoFilter->Begin(temporaryPath);
+	}
+	return temporaryPath;
+}
+
+// Replace the destination with the temporary file of a full copy that
+// succeeded, or delete the temporary file of one that failed or was
+// cancelled so the destination keeps its last complete contents.
+bool Copier::EndTemporary(tstring const& temporaryPath, tstring const& destinationPath, bool copied) {
+	copied = copied && FileSystem::Replace(temporaryPath, destinationPath);
+	if(!copied) {
+		FileSystem::Delete(temporaryPath);
+	}
+	if(echoFilter) {
+		echoFilter->End(temporaryPath, nullptr, EchoFilter::Clock::now());
+	}
+	return copied;
+}
+
+// Copy through a pipeline that overlaps reading the source with writing the
+// destination.
+bool Copier::CopyStreamed(tstring const& sourcePath, tstring const& destinationPath, FileSystem::Info const& sourceInfo,
+	FileSystem::Progress const& progress) {
+	FileSystem::File source, destination;
+	if(!source.Open(sourcePath, FileSystem::File::ReadOnly, options.directIo)) {
+		return false;
+	}
+	tstring temporaryPath = BeginTemporary(destinationPath);
+	long long written = -1;
+	if(destination.Open(temporaryPath, FileSystem::File::Create, options.directIo)) {
+		Pipeline pipeline(options.streamBufferSize, options.streamDepth);
+		written = pipeline.Copy(source, destination, progress);
+	}
+	bool copied = written >= 0 && destination.SetTime(sourceInfo.lastWriteTime) && destination.Close();
+	destination.Close();
+	if(!EndTemporary(temporaryPath, destinationPath, copied)) {
+		return false;
+	}
+	++streamedCopyCount;
+	bytesWritten += written;
+	return true;
+}
+
+// Stream the source through a pipeline to all destinations at once so it
+// is read once however many there are.
+void Copier::CopyFannedOut(tstring const& sourcePath, std::vector<tstring> const& destinationPaths, FileSystem::Info const& sourceInfo,
+	std::atomic<bool> const* isCancelled, std::vector<Result>& results) {
+	results.assign(destinationPaths.size(), Failed);
+	FileSystem::File source;
+	if(!source.Open(sourcePath, FileSystem::File::ReadOnly, options.directIo)) {
+		return;
+	}
+	std::vector<std::unique_ptr<FileSystem::File>> files;
+	std::vector<FileSystem::File*> destinations;
+	std::vector<size_t> positions;
+	std::vector<tstring> temporaryPaths;
+	for(size_t k = 0; k < destinationPaths.size(); ++k) {
+		tstring temporaryPath = BeginTemporary(destinationPaths[k]);
+		std::unique_ptr<FileSystem::File> file(new FileSystem::File);
+		if(file->Open(temporaryPath, FileSystem::File::Create, options.directIo)) {
+			destinations.push_back(file.get());
+			positions.push_back(k);
+			temporaryPaths.push_back(temporaryPath);
+			files.push_back(std::move(file));
+		} else {
+			EndTemporary(temporaryPath, destinationPaths[k], false);
+		}
+	}
+	std::vector<Throttle*> throttles;
+	GetThrottles(sourceInfo, destinationPaths, throttles);
+	Pipeline pipeline(options.streamBufferSize, options.streamDepth);
+	std::vector<long long> written;
+	pipeline.Copy(source, destinations, Pace(throttles, isCancelled), written);
+	for(size_t j = 0; j < destinations.size(); ++j) {
+		size_t k = positions[j];
+		bool copied = written[j] >= 0 && destinations[j]->SetTime(sourceInfo.lastWriteTime) && destinations[j]->Close();
+		destinations[j]->Close();
+		if(!EndTemporary(temporaryPaths[j], destinationPaths[k], copied)) {
+			results[k] = isCancelled && *isCancelled ? Cancelled : Failed;
+			continue;
+		}
+		results[k] = Copied;
+		++streamedCopyCount;
+		bytesWritten += written[j];
+		if(options.report) {
+			options.report(sourcePath, destinationPaths[k], "fan-out");
+		}
+	}
+}
+
+// Rewrite the blocks of the destination that differ from the source in
+// place, then fix its size and last write time.
+bool Copier::CopyDelta(tstring const& sourcePath, tstring const& destinationPath, FileSystem::Info const& sourceInfo, unsigned long long destinationSize,
+	FileSystem::Progress const& progress) {
+	FileSystem::File source, destination;
+	if(!source.Open(sourcePath, FileSystem::File::ReadOnly) || !destination.Open(destinationPath, FileSystem::File::ReadWrite)) {
+		return false;
+	}
+	std::vector<char> sourceBuffer(options.blockSize), destinationBuffer(options.blockSize);
+	unsigned long long offset = 0, compared = 0, written = 0;
+	for(;;) {
+		long long n = source.Read(offset, &sourceBuffer[0], sourceBuffer.size());
+		if(n < 0) {
+			return false;
+		} else if(n == 0) {
+			break;
+		}
+		long long m = offset < destinationSize ? destination.Read(offset, &destinationBuffer[0], static_cast<size_t>(n)) : 0;
+		if(m < 0) {
+			return false;
+		}
+		compared += m;
+		if(m != n || memcmp(&sourceBuffer[0], &destinationBuffer[0], static_cast<size_t>(n)) != 0) {
+			if(!destination.Write(offset, &sourceBuffer[0], static_cast<size_t>(n))) {
+				return false;
+			}
+			written += n;
+		}
+		offset += n;
+		if(progress && !progress(n)) {
+			return false;
+		}
+	}
+	if(offset != destinationSize && !destination.SetSize(offset)) {
+		return false;
+	}
+
+	// Preserve the last write time as a full copy does.
+	if(!destination.SetTime(sourceInfo.lastWriteTime) || !destination.Close()) {
+		return false;
+	}
+	++deltaCopyCount;
+	bytesCompared += compared;
+	bytesWritten += written;
+	return true;
+}
+
+Copier::Statistics Copier::get_Statistics() const {
+	Statistics statistics = { fullCopyCount, deltaCopyCount, streamedCopyCount, unchangedCount, bytesCompared, bytesWritten, bytesHashed, {} };
+	for(int i = 0; i < FileSystem::CopyMethodCount; ++i) {
+		statistics.methodCounts[i] = methodCounts[i];
+	}
+	return statistics;
+}
+
+char const* Copier::GetMethodName(FileSystem::CopyMethod method) {
+	static char const* const names[] = { "native", "clone", "in-kernel", "sendfile", "buffered" };
+	static_assert(_countof(names) == FileSystem::CopyMethodCount, "missing copy method name");
+	return names[method];
+}
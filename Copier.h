@@ -0,0 +1,149 @@
+#pragma once
+
+#include "EchoFilter.h"
+#include "FileSystem.h"
+#include "HashCache.h"
+#include "Metrics.h"
+#include "Throttle.h"
+
+// A copier copies a changed file to its other file.  Above a size
+// threshold, when the other file exists, it compares the two in blocks and
+// writes only the blocks that differ.  Optionally, it compares content
+// hashes first and only updates the last write time of an identical file.
+// It defers copies of large files still being written and throttles the
+// rest to configured rates.
+class Copier
+{
+public:
+	enum Result { Failed, Copied, Unchanged, Deferred, Cancelled };
+
+	// This is a rate of I/O per second, where an operation is a chunk of a
+	// copy.  Zero is no limit.
+	struct Limit
+	{
+		unsigned long long bytesPerSecond, operationsPerSecond;
+	};
+
+	struct Options
+	{
+		// Zero disables delta copies.
+		unsigned long long deltaThreshold;
+		size_t blockSize;
+
+		// Copies of files at least this large to another device stream
+		// through streamDepth buffers of streamBufferSize bytes, reading
+		// ahead while writing.  Zero disables streamed copies.  Direct I/O
+		// keeps them out of the system cache.
+		unsigned long long streamThreshold;
+		size_t streamBufferSize;
+		unsigned streamDepth;
+		bool directIo;
+
+		// Compare content hashes, remembered in the hash cache file if it
+		// has a path, before copying.
+		bool compareContents;
+		tstring hashCachePath;
+
+		// Copies of files at least this large wait until the file is stable:
+		// no other process has it open for writing or, where the platform
+		// cannot tell, probes stabilityTime apart see the same size and last
+		// write time.  A file waits at most maximumStabilityWait.  Zero
+		// disables the wait.
+		unsigned long long stabilityThreshold;
+		std::chrono::milliseconds stabilityTime, maximumStabilityWait;
+
+		// All copies together stay within the limit, and those reading or
+		// writing a device in deviceLimits within its limit as well.
+		Limit limit;
+		std::map<FileSystem::Device, Limit> deviceLimits;
+
+		// If set, this receives the source path, destination path, and name
+		// of the method of each copy.  Workers call it concurrently.
+		std::function<void(tstring const&, tstring const&, char const*)> report;
+	};
+
+	struct Statistics
+	{
+		unsigned long long fullCopyCount, deltaCopyCount, streamedCopyCount, unchangedCount, bytesCompared, bytesWritten, bytesHashed;
+
+		// These count the full copies by method.
+		unsigned long long methodCounts[FileSystem::CopyMethodCount];
+	};
+
+	Copier();
+	void Configure(Options const& options);
+	Options const& get_Options() const { return options; }
+
+	// Copy the contents and last write time of the source file, or defer
+	// the copy if the source is not stable.  Stop between chunks once the
+	// flag, if given, is set.  Full copies write a temporary file and
+	// replace the destination only once complete; a delta copy stopped
+	// early leaves the destination partial until the next copy.  Other
+	// threads may call this concurrently.
+	Result Copy(tstring const& sourcePath, tstring const& destinationPath, std::atomic<bool> const* isCancelled);
+
+	// Copy the source file to several destinations and get the result of
+	// each.  Those that would each get a streamed copy share one read of
+	// the source; the rest copy as above.
+	void Copy(tstring const& sourcePath, std::vector<tstring> const& destinationPaths, std::atomic<bool> const* isCancelled,
+		std::vector<Result>& results);
+
+	// Count copies, their times, and the time they wait for the throttles in
+	// the metrics, if set.
+	void SetMetrics(Metrics* metrics) { this->metrics = metrics; }
+
+	// Tell the echo filter, if set, about each write.
+	void SetEchoFilter(EchoFilter* echoFilter) { this->echoFilter = echoFilter; }
+
+	// Save the hash cache.  Copies also save it every few minutes so a
+	// crash loses little of it.
+	bool Flush();
+
+	Statistics get_Statistics() const;
+
+	static char const* GetMethodName(FileSystem::CopyMethod method);
+
+private:
+	Options options;
+	HashCache hashCache;
+	Metrics* metrics;
+	EchoFilter* echoFilter;
+	std::atomic<unsigned long long> fullCopyCount, deltaCopyCount, streamedCopyCount, unchangedCount, bytesCompared, bytesWritten, bytesHashed;
+	std::atomic<unsigned long long> methodCounts[FileSystem::CopyMethodCount];
+
+	// This is the first probe of a file waiting to be stable and the
+	// information of the last one.
+	struct Probe
+	{
+		std::chrono::steady_clock::time_point firstTime;
+		unsigned long long size;
+		FileSystem::Time lastWriteTime;
+	};
+	std::mutex mutex;
+	std::unordered_map<tstring, Probe> probes;
+	std::chrono::steady_clock::time_point nextFlushTime;
+
+	// Configure builds these and copies only read them.
+	Throttle throttle;
+	std::map<FileSystem::Device, std::unique_ptr<Throttle>> deviceThrottles;
+
+	bool WouldStream(FileSystem::Info const& sourceInfo, tstring const& destinationPath);
+	Result Transfer(tstring const& sourcePath, FileSystem::Info const& sourceInfo, tstring const& destinationPath, std::atomic<bool> const* isCancelled);
+	bool IsStable(tstring const& filePath, FileSystem::Info const& info);
+	void FlushPeriodically();
+	void Finish(tstring const& destinationPath, Result result, unsigned long long size, std::chrono::steady_clock::time_point startTime);
+	void GetThrottles(FileSystem::Device device, std::vector<Throttle*>& throttles);
+	void GetThrottles(FileSystem::Info const& sourceInfo, std::vector<tstring> const& destinationPaths, std::vector<Throttle*>& throttles);
+	FileSystem::Progress Pace(std::vector<Throttle*> const& throttles, std::atomic<bool> const* isCancelled);
+	bool HaveSameContents(tstring const& sourcePath, FileSystem::Info const& sourceInfo, tstring const& destinationPath,
+		FileSystem::Info const& destinationInfo, unsigned long long& sourceHash);
+
+	tstring BeginTemporary(tstring const& destinationPath);
+	bool EndTemporary(tstring const& temporaryPath, tstring const& destinationPath, bool copied);
+	bool CopyStreamed(tstring const& sourcePath, tstring const& destinationPath, FileSystem::Info const& sourceInfo,
+		FileSystem::Progress const& progress);
+	void CopyFannedOut(tstring const& sourcePath, std::vector<tstring> const& destinationPaths, FileSystem::Info const& sourceInfo,
+		std::atomic<bool> const* isCancelled, std::vector<Result>& results);
+	bool CopyDelta(tstring const& sourcePath, tstring const& destinationPath, FileSystem::Info const& sourceInfo, unsigned long long destinationSize,
+		FileSystem::Progress const& progress);
+};
@@ -0,0 +1,279 @@
+#include "stdafx.h"
+#include "Batch.h"
+#include "MetricsServer.h"
+#include "Settings.h"
+#include "SyncEngine.h"
+
+// This is the headless front end of the engine.  It runs in the foreground
+// until it receives SIGINT or SIGTERM, reloads its settings on SIGHUP, and
+// prints its statistics on SIGUSR1.  It can also write its metrics to a
+// file periodically and serve them on a Unix socket.
+//
+// With -1, it synchronizes every entry once instead, prints the result of
+// each, and exits with 0 if all entries match, 1 if it cannot read the
+// settings, 2 for bad arguments, or 3 if any entry failed or lacks its
+// main file.
+
+static void Usage(char const* programName) {
+	fprintf(stderr, "usage: %s [-1] [-c settings-file] [-q quiet-milliseconds] [-m maximum-delay-milliseconds]\n"
+		"\t[-w worker-count] [-d copies-per-device] [-D delta-threshold-megabytes] [-H] [-v]\n"
+		"\t[-S stream-threshold-megabytes] [-b stream-buffer-kilobytes] [-Q stream-depth] [-O]\n"
+		"\t[-M metrics-file] [-i metrics-interval-seconds] [-U metrics-socket]\n"
+		"\t[-p minimum-poll-seconds] [-P maximum-poll-seconds]\n"
+		"\t[-s stable-threshold-megabytes] [-W maximum-stable-wait-seconds]\n"
+		"\t[-r megabytes-per-second] [-n operations-per-second] [-l path=megabytes-per-second[/operations-per-second]]... [-B]\n",
+		programName);
+}
+
+// Parse a limit for the device holding a path.
+static bool ParseDeviceLimit(char const* s, Copier::Options& options) {
+	char const* equals = strrchr(s, '=');
+	FileSystem::Info info;
+	if(equals == nullptr || !FileSystem::GetInfo(tstring(s, equals), info)) {
+		return false;
+	}
+	char* end;
+	Copier::Limit limit = { strtoull(equals + 1, &end, 10) << 20, 0 };
+	if(*end == '/') {
+		limit.operationsPerSecond = strtoull(end + 1, &end, 10);
+	}
+	if(*end != '\0') {
+		return false;
+	}
+	options.deviceLimits[info.device] = limit;
+	return true;
+}
+
+static void PrintCopyStatistics(Copier::Statistics const& copyStatistics, Metrics const& metrics) {
+	fprintf(stderr, "full copies %llu, delta copies %llu, streamed copies %llu, unchanged %llu, bytes compared %llu, bytes written %llu, bytes hashed %llu\n",
+		copyStatistics.fullCopyCount, copyStatistics.deltaCopyCount, copyStatistics.streamedCopyCount, copyStatistics.unchangedCount, copyStatistics.bytesCompared,
+		copyStatistics.bytesWritten, copyStatistics.bytesHashed);
+	fprintf(stderr, "copies by method:");
+	for(int i = 0; i < FileSystem::CopyMethodCount; ++i) {
+		fprintf(stderr, " %s %llu", Copier::GetMethodName(static_cast<FileSystem::CopyMethod>(i)), copyStatistics.methodCounts[i]);
+	}
+	fputc('\n', stderr);
+	fputs(metrics.FormatText().c_str(), stderr);
+}
+
+static void PrintStatistics(SyncEngine const& engine) {
+	SyncEngine::Statistics statistics = engine.get_Statistics();
+	fprintf(stderr, "events %llu, coalesced %llu, synchronizations %llu, copies %llu\n", statistics.eventCount,
+		statistics.coalescedEventCount, statistics.synchronizationCount, statistics.copyCount);
+	PrintCopyStatistics(engine.get_CopyStatistics(), engine.get_Metrics());
+}
+
+static void ReportCopy(tstring const& sourcePath, tstring const& destinationPath, char const* methodName) {
+	fprintf(stderr, "%s -> %s (%s)\n", sourcePath.c_str(), destinationPath.c_str(), methodName);
+}
+
+static bool LoadSettings(tstring const& path, std::vector<Entry>& entries) {
+	if(!Settings::Load(path, entries)) {
+		fprintf(stderr, "cannot read settings from %s\n", path.c_str());
+		return false;
+	}
+	if(entries.empty()) {
+		fprintf(stderr, "no entries in %s\n", path.c_str());
+		return false;
+	}
+	fprintf(stderr, "synchronizing %u entries from %s\n", (unsigned)entries.size(), path.c_str());
+	return true;
+}
+
+// Synchronize the entries once and print a line for each: its status, the
+// number of files copied, and its paths.
+static int RunOnce(std::vector<Entry> const& entries, unsigned workerCount, unsigned deviceLimit, bool isBackground,
+	Copier::Options const& copyOptions) {
+	Batch batch;
+	batch.ConfigureWorkers(workerCount, deviceLimit, isBackground);
+	batch.ConfigureCopying(copyOptions);
+	auto startTime = std::chrono::steady_clock::now();
+	std::vector<Batch::Result> results;
+	bool succeeded = batch.Run(entries, results);
+	auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime);
+	unsigned statusCounts[Batch::StatusCount] = {};
+	for(size_t i = 0; i < entries.size(); ++i) {
+		printf("%s\t%u\t%s\t%s\n", Batch::GetStatusName(results[i].status), results[i].copyCount, entries[i].get_Path1().c_str(),
+			entries[i].get_Path2().c_str());
+		++statusCounts[results[i].status];
+	}
+	fflush(stdout);
+	for(int i = 0; i < Batch::StatusCount; ++i) {
+		fprintf(stderr, "%s%s %u", i == 0 ? "" : ", ", Batch::GetStatusName(static_cast<Batch::Status>(i)), statusCounts[i]);
+	}
+	fprintf(stderr, " in %lld milliseconds\n", static_cast<long long>(duration.count()));
+	PrintCopyStatistics(batch.get_CopyStatistics(), batch.get_Metrics());
+	return succeeded ? 0 : 3;
+}
+
+int main(int argc, char* argv[]) {
+	tstring settingsPath;
+	std::chrono::milliseconds quietTime(200), maximumDelay(2000);
+	std::chrono::seconds minimumPollInterval(2), maximumPollInterval(60);
+	unsigned workerCount = 0, deviceLimit = 4;
+	bool isBackground = false, isOnce = false;
+	Copier::Options copyOptions = Copier().get_Options();
+	tstring metricsPath, metricsSocketPath;
+	unsigned metricsInterval = 10;
+	int option;
+	while((option = getopt(argc, argv, "1Bb:c:D:d:Hi:l:M:m:n:OP:p:Q:q:r:S:s:U:vW:w:")) != -1) {
+		switch(option) {
+		case '1':
+			isOnce = true;
+			break;
+		case 'B':
+			isBackground = true;
+			break;
+		case 'b':
+			copyOptions.streamBufferSize = strtoul(optarg, nullptr, 10) << 10;
+			break;
+		case 'c':
+			settingsPath = optarg;
+			break;
+		case 'D':
+			copyOptions.deltaThreshold = strtoull(optarg, nullptr, 10) << 20;
+			break;
+		case 'd':
+			deviceLimit = strtoul(optarg, nullptr, 10);
+			break;
+		case 'H':
+			copyOptions.compareContents = true;
+			break;
+		case 'i':
+			metricsInterval = std::max(1ul, strtoul(optarg, nullptr, 10));
+			break;
+		case 'l':
+			if(!ParseDeviceLimit(optarg, copyOptions)) {
+				fprintf(stderr, "bad device limit %s\n", optarg);
+				return 2;
+			}
+			break;
+		case 'M':
+			metricsPath = optarg;
+			break;
+		case 'm':
+			maximumDelay = std::chrono::milliseconds(strtoul(optarg, nullptr, 10));
+			break;
+		case 'n':
+			copyOptions.limit.operationsPerSecond = strtoull(optarg, nullptr, 10);
+			break;
+		case 'O':
+			copyOptions.directIo = true;
+			break;
+		case 'P':
+			maximumPollInterval = std::chrono::seconds(strtoul(optarg, nullptr, 10));
+			break;
+		case 'p':
+			minimumPollInterval = std::chrono::seconds(std::max(strtoul(optarg, nullptr, 10), 1ul));
+			break;
+		case 'Q':
+			copyOptions.streamDepth = strtoul(optarg, nullptr, 10);
+			break;
+		case 'q':
+			quietTime = std::chrono::milliseconds(strtoul(optarg, nullptr, 10));
+			break;
+		case 'r':
+			copyOptions.limit.bytesPerSecond = strtoull(optarg, nullptr, 10) << 20;
+			break;
+		case 'S':
+			copyOptions.streamThreshold = strtoull(optarg, nullptr, 10) << 20;
+			break;
+		case 's':
+			copyOptions.stabilityThreshold = strtoull(optarg, nullptr, 10) << 20;
+			break;
+		case 'U':
+			metricsSocketPath = optarg;
+			break;
+		case 'v':
+			copyOptions.report = ReportCopy;
+			break;
+		case 'W':
+			copyOptions.maximumStabilityWait = std::chrono::seconds(strtoul(optarg, nullptr, 10));
+			break;
+		case 'w':
+			workerCount = strtoul(optarg, nullptr, 10);
+			break;
+		default:
+			Usage(argv[0]);
+			return 2;
+		}
+	}
+	if(optind != argc) {
+		Usage(argv[0]);
+		return 2;
+	}
+	if(settingsPath.empty()) {
+		// Fall back to the text settings file of earlier versions.
+		FileSystem::Info info;
+		settingsPath = Settings::GetPath(false);
+		if(!FileSystem::GetInfo(settingsPath, info)) {
+			settingsPath = Settings::GetTextPath();
+		}
+	}
+	if(copyOptions.compareContents) {
+		// Keep the hash cache beside the settings.
+		copyOptions.hashCachePath = FileSystem::Combine(FileSystem::GetFolder(settingsPath), "HashCache.dat");
+	}
+
+	if(isOnce) {
+		std::vector<Entry> entries;
+		if(!LoadSettings(settingsPath, entries)) {
+			return 1;
+		}
+		return RunOnce(entries, workerCount, deviceLimit, isBackground, copyOptions);
+	}
+
+	// Block the signals of interest before starting any threads so only this
+	// thread receives them.
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGHUP);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	sigaddset(&signals, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+	std::vector<Entry> entries;
+	if(!LoadSettings(settingsPath, entries)) {
+		return 1;
+	}
+	SyncEngine engine;
+	engine.ConfigureCoalescing(quietTime, maximumDelay);
+	engine.ConfigureWorkers(workerCount, deviceLimit);
+	engine.ConfigurePriority(isBackground);
+	engine.ConfigurePolling(minimumPollInterval, maximumPollInterval);
+	engine.ConfigureCopying(copyOptions);
+	engine.Start(entries);
+	MetricsServer metricsServer(engine.get_Metrics());
+	if(!metricsSocketPath.empty() && !metricsServer.Start(metricsSocketPath)) {
+		fprintf(stderr, "cannot serve metrics on %s\n", metricsSocketPath.c_str());
+	}
+	timespec timeout = { static_cast<time_t>(metricsInterval), 0 };
+	for(;;) {
+		// Wake up to write the metrics if there is a file for them.
+		int signalNumber = metricsPath.empty() ? sigwaitinfo(&signals, nullptr) : sigtimedwait(&signals, nullptr, &timeout);
+		if(signalNumber < 0) {
+			if(errno == EAGAIN) {
+				engine.get_Metrics().WriteSnapshot(metricsPath);
+			}
+			continue;
+		}
+		if(signalNumber == SIGHUP) {
+			entries.clear();
+			if(LoadSettings(settingsPath, entries)) {
+				engine.SetEntries(entries);
+			}
+		} else if(signalNumber == SIGUSR1) {
+			PrintStatistics(engine);
+		} else {
+			break;
+		}
+	}
+	metricsServer.Stop();
+	engine.Stop();
+	if(!metricsPath.empty()) {
+		engine.get_Metrics().WriteSnapshot(metricsPath);
+	}
+	PrintStatistics(engine);
+	return 0;
+}
@@ -91,12 +91,12 @@ static bool AppendItem(HWND listView, Entry& entry)
 		return false;
 	listItem.mask= LVIF_TEXT;
 	listItem.iSubItem= 1;
-	entry.GetPath1(listItem.pszText);
+	listItem.pszText= const_cast<LPTSTR>(entry.get_Path1().c_str());
 	if(!ListView_SetItem(listView, &listItem))
 		return false;
 	listItem.mask= LVIF_TEXT;
 	listItem.iSubItem= 2;
-	entry.GetPath2(listItem.pszText);
+	listItem.pszText= const_cast<LPTSTR>(entry.get_Path2().c_str());
 	if(!ListView_SetItem(listView, &listItem))
 		return false;
 	ListView_SetCheckState(listView, index, isTwoWay);
@@ -113,10 +113,30 @@ static bool AppendItems(HWND listView, std::vector<Entry>& entries)
 	return true;
 }
 
+static bool SelectFile(HWND window, LPTSTR filePath, bool isPrimary)
+{
+	OPENFILENAME ofn= {};
+	ofn.lStructSize= sizeof(ofn);
+	ofn.hwndOwner= window;
+	ofn.lpstrFile= filePath;
+	ofn.nMaxFile= MAX_PATH;
+	ofn.lpstrTitle= isPrimary ? _T("Choose Main File") : _T("Choose Back-up File");
+	ofn.Flags= OFN_DONTADDTORECENT | OFN_HIDEREADONLY;
+	if(isPrimary)
+		ofn.Flags= OFN_FILEMUSTEXIST | OFN_PATHMUSTEXIST;
+	return !!GetOpenFileName(&ofn);
+}
+
+static bool SelectEntry(HWND window, Entry& entry)
+{
+	TCHAR path1[MAX_PATH]= {}, path2[MAX_PATH]= {};
+	return SelectFile(window, path1, true) && SelectFile(window, path2, false) && entry.Create(path1, path2);
+}
+
 static bool AddEntry(HWND dialog, std::vector<Entry>& entries)
 {
 	Entry entry;
-	if(entry.SelectFromUser(dialog))
+	if(SelectEntry(dialog, entry))
 	{
 		entries.push_back(entry);
 		AppendItem(GetDlgItem(dialog, IDC_LIST), entry);
@@ -0,0 +1,75 @@
+#include "stdafx.h"
+#include "EchoFilter.h"
+
+void EchoFilter::Begin(tstring const& filePath) {
+	std::lock_guard<std::mutex> lock(mutex);
+	Write& write = writes[FileSystem::GetKey(filePath)];
+	if(write.count++ == 0) {
+		write.filePath = filePath;
+		write.hasInfo = false;
+	}
+}
+
+void EchoFilter::End(tstring const& filePath, FileSystem::Info const* info, Clock::time_point now) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = writes.find(FileSystem::GetKey(filePath));
+	if(it == writes.end() || it->second.count == 0) {
+		return;
+	}
+	Write& write = it->second;
+	--write.count;
+	write.hasInfo = info != nullptr;
+	if(info) {
+		write.info = *info;
+	}
+	write.endTime = now;
+}
+
+// An event during a write is the write's own; the write replaces the file
+// whatever else changes it meanwhile.  After the write, an event is an echo
+// only if the file is still as the write left it.
+bool EchoFilter::IsEcho(Watcher::Event const& event) const {
+	if(event.action == Watcher::Overflow) {
+		return false;
+	}
+	tstring filePath = FileSystem::Combine(event.folderPath, event.name);
+	FileSystem::Info info;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if(writes.empty()) {
+			return false;
+		}
+		auto it = writes.find(FileSystem::GetKey(filePath));
+		if(it == writes.end()) {
+			return false;
+		} else if(it->second.count > 0) {
+			return true;
+		} else if(!it->second.hasInfo) {
+			return false;
+		}
+		info = it->second.info;
+	}
+	FileSystem::Info currentInfo;
+	return FileSystem::GetInfo(filePath, currentInfo) && currentInfo.size == info.size && currentInfo.lastWriteTime == info.lastWriteTime
+		&& (currentInfo.fileId == 0 || info.fileId == 0 || currentInfo.fileId == info.fileId);
+}
+
+void EchoFilter::Expire(Clock::time_point time, std::vector<std::pair<tstring, FileSystem::Info>>& writes) {
+	std::lock_guard<std::mutex> lock(mutex);
+	for(auto it = this->writes.begin(); it != this->writes.end();) {
+		Write const& write = it->second;
+		if(write.count == 0 && write.endTime < time) {
+			if(write.hasInfo) {
+				writes.push_back(std::make_pair(write.filePath, write.info));
+			}
+			it = this->writes.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+void EchoFilter::Clear() {
+	std::lock_guard<std::mutex> lock(mutex);
+	writes.clear();
+}
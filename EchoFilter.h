@@ -0,0 +1,50 @@
+#pragma once
+
+#include "FileSystem.h"
+#include "Watcher.h"
+
+// An echo filter recognizes the change events the engine's own writes
+// cause so they do not synchronize the entry a second time.  Workers
+// bracket each write with Begin and End.  The engine drops the events for
+// a file while a worker writes it and, until a wait that began after the
+// write ended, since the platform queued the write's events by then, those
+// for which the file still has the size, last write time, and identifier
+// the write left.
+class EchoFilter
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	EchoFilter() {}
+
+	// Other threads may call these concurrently.  The information is that
+	// of the written file, if known.
+	void Begin(tstring const& filePath);
+	void End(tstring const& filePath, FileSystem::Info const* info, Clock::time_point now);
+
+	// Determine whether an event is the echo of a write.  This looks at the
+	// file if a write of it ended.
+	bool IsEcho(Watcher::Event const& event) const;
+
+	// Forget the writes that ended before the given time and append the
+	// paths and information of those with information.
+	void Expire(Clock::time_point time, std::vector<std::pair<tstring, FileSystem::Info>>& writes);
+
+	void Clear();
+
+private:
+	struct Write
+	{
+		tstring filePath;
+		unsigned count;
+		bool hasInfo;
+		FileSystem::Info info;
+		Clock::time_point endTime;
+	};
+
+	mutable std::mutex mutex;
+	std::unordered_map<tstring, Write> writes;
+
+	EchoFilter(EchoFilter const&); // undefined
+	EchoFilter& operator=(EchoFilter const&); // undefined
+};
@@ -1,27 +1,39 @@
 #pragma once
-#pragma warning(disable: 4351) /* new behavior: elements of array will be default initialized */
+
+#include "FileSystem.h"
 
 class Entry
 {
 private:
-	TCHAR path1[MAX_PATH];
-	TCHAR path2[MAX_PATH];
-	FILETIME lastWriteTime1, lastWriteTime2;
-	bool isTwoWay;
+	tstring path1;
+	tstring path2;
+	FileSystem::Time lastWriteTime1, lastWriteTime2;
+	FileSystem::Device device1, device2;
+	bool isTwoWay, isTree;
 
 public:
-	Entry() : path1(), path2(), lastWriteTime1(), lastWriteTime2(), isTwoWay(false) {}
-	void AddFolder(std::set<tstring>& folderPaths);
-	void Create(LPCTSTR path1, LPCTSTR path2);
-	bool CreateFromString(LPTSTR string);
-	void SaveToFile(FILE* fout);
-	void Synchronize();
-	bool SelectFromUser(HWND window);
-	void GetPath1(LPTSTR& p);
-	void GetPath2(LPTSTR& p);
+	// These are the bits of the flags of an entry as the settings store
+	// them.  A tree entry mirrors a folder tree rather than pairing files.
+	enum Flag { TwoWay = 1, Tree = 2 };
+
+	Entry() : lastWriteTime1(), lastWriteTime2(), device1(), device2(), isTwoWay(false), isTree(false) {}
+	void AddFolder(std::set<tstring>& folderPaths) const;
+	bool Create(tstring const& path1, tstring const& path2);
+	bool CreateFromString(tstring const& string);
+	bool CreateFromPaths(tstring const& path1, tstring const& path2, unsigned flags);
+	tstring const& get_Path1() const { return path1; }
+	tstring const& get_Path2() const { return path2; }
+	FileSystem::Time get_LastWriteTime1() const { return lastWriteTime1; }
+	FileSystem::Time get_LastWriteTime2() const { return lastWriteTime2; }
+	FileSystem::Device get_Device1() const { return device1; }
+	FileSystem::Device get_Device2() const { return device2; }
+#ifdef _MSC_VER
 	_declspec(property(get=get_IsTwoWay,put=put_IsTwoWay)) bool IsTwoWay;
+#endif
 	bool get_IsTwoWay() const { return isTwoWay; }
 	void put_IsTwoWay(bool value) { isTwoWay= value; }
+	bool get_IsTree() const { return isTree; }
+	unsigned get_Flags() const { return (isTwoWay ? TwoWay : 0) | (isTree ? Tree : 0); }
 
 private:
 	bool CheckBackup();
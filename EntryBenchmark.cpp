@@ -0,0 +1,95 @@
+#include "stdafx.h"
+#include "EntryTable.h"
+#include <malloc.h>
+
+// This compares the memory per entry and the time of a pass over all
+// entries checking for changed last write times between a vector of entries
+// and an entry table.
+
+typedef std::chrono::steady_clock Clock;
+
+// Count both the small blocks and those mapped on their own.
+static size_t GetHeapSize() {
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+}
+
+// Make the entries of a typical configuration: main files spread over some
+// folders, each backed up to a parallel folder on another disk.
+static void MakeEntries(size_t entryCount, size_t folderCount, std::vector<Entry>& entries) {
+	entries.reserve(entryCount);
+	for(size_t i = 0; i < entryCount; ++i) {
+		tstring folderPath = "/home/user/Documents/projects/folder-" + std::to_string(i % folderCount);
+		tstring name = "document-" + std::to_string(i) + ".txt";
+		Entry entry;
+		entry.CreateFromPaths(FileSystem::Combine(folderPath, name), FileSystem::Combine("/mnt/backup" + folderPath, name), i % 2 != 0 ? Entry::TwoWay : 0);
+		entries.push_back(entry);
+	}
+}
+
+template<typename F>
+static double MeasureScan(size_t entryCount, size_t passCount, F isChanged) {
+	size_t changedCount = 0;
+	Clock::time_point start = Clock::now();
+	for(size_t pass = 0; pass < passCount; ++pass) {
+		for(size_t i = 0; i < entryCount; ++i) {
+			changedCount += isChanged(i, pass);
+		}
+	}
+	double nanoseconds = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+	// Use the count so the compiler keeps the loop.
+	if(changedCount == SIZE_MAX) {
+		puts("");
+	}
+	return nanoseconds / (entryCount * passCount);
+}
+
+int main(int argc, char* argv[]) {
+	size_t entryCount = 100000, folderCount = 1000, passCount = 20;
+	int option;
+	while((option = getopt(argc, argv, "f:n:p:")) != -1) {
+		switch(option) {
+		case 'f':
+			folderCount = std::max(strtoul(optarg, nullptr, 10), 1ul);
+			break;
+		case 'n':
+			entryCount = std::max(strtoul(optarg, nullptr, 10), 1ul);
+			break;
+		case 'p':
+			passCount = std::max(strtoul(optarg, nullptr, 10), 1ul);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n entry-count] [-f folder-count] [-p pass-count]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	// The observed times differ from the recorded ones in a few entries.
+	std::vector<FileSystem::Time> observedTimes(entryCount);
+	for(size_t i = 0; i < entryCount; i += 97) {
+		observedTimes[i] = i;
+	}
+
+	size_t heapSize = GetHeapSize();
+	std::vector<Entry> entries;
+	MakeEntries(entryCount, folderCount, entries);
+	size_t vectorSize = GetHeapSize() - heapSize;
+	double vectorScanTime = MeasureScan(entryCount, passCount, [&](size_t i, size_t pass) {
+		return entries[(i + pass) % entryCount].get_LastWriteTime1() != observedTimes[i];
+	});
+
+	heapSize = GetHeapSize();
+	EntryTable table;
+	table.Build(entries);
+	size_t tableSize = GetHeapSize() - heapSize;
+	double tableScanTime = MeasureScan(entryCount, passCount, [&](size_t i, size_t pass) {
+		return table.get_LastWriteTime1((i + pass) % entryCount) != observedTimes[i];
+	});
+
+	printf("# %u entries in %u folders\n", (unsigned)entryCount, (unsigned)folderCount);
+	printf("# %-8s %14s %14s\n", "layout", "bytes/entry", "scan ns/entry");
+	printf("  %-8s %14.1f %14.2f\n", "vector", static_cast<double>(vectorSize) / entryCount, vectorScanTime);
+	printf("  %-8s %14.1f %14.2f\n", "table", static_cast<double>(tableSize) / entryCount, tableScanTime);
+	return 0;
+}
@@ -0,0 +1,91 @@
+#include "stdafx.h"
+#include "EntryIndex.h"
+
+void EntryIndex::Build(std::vector<Entry> const& entries) {
+	Clear();
+	for(size_t i = 0; i < entries.size(); ++i) {
+		Add(i, entries[i]);
+	}
+}
+
+void EntryIndex::Clear() {
+	files.clear();
+	folders.clear();
+	trees.clear();
+	fileIndices.clear();
+	treeIndices.clear();
+}
+
+void EntryIndex::Add(size_t i, Entry const& entry) {
+	if(entry.get_IsTree()) {
+		// A tree responds to changes anywhere below its roots.
+		treeIndices.push_back(i);
+		trees[FileSystem::GetKey(entry.get_Path1())].push_back(i);
+		if(entry.get_IsTwoWay()) {
+			trees[FileSystem::GetKey(entry.get_Path2())].push_back(i);
+		}
+		return;
+	}
+	fileIndices.push_back(i);
+	files[FileSystem::GetKey(entry.get_Path1())].push_back(i);
+	folders[FileSystem::GetKey(FileSystem::GetFolder(entry.get_Path1()))].push_back(i);
+
+	// Only a two-way entry responds to changes of its back-up file.
+	if(entry.get_IsTwoWay()) {
+		files[FileSystem::GetKey(entry.get_Path2())].push_back(i);
+		folders[FileSystem::GetKey(FileSystem::GetFolder(entry.get_Path2()))].push_back(i);
+	}
+}
+
+void EntryIndex::Find(Watcher::Event const& event, std::vector<size_t>& indices) const {
+	if(event.action == Watcher::Overflow) {
+		if(event.folderPath.empty()) {
+			// The watcher lost events for all folders.
+			indices.insert(indices.end(), fileIndices.begin(), fileIndices.end());
+		} else {
+			auto it = folders.find(FileSystem::GetKey(event.folderPath));
+			if(it != folders.end()) {
+				indices.insert(indices.end(), it->second.begin(), it->second.end());
+			}
+		}
+	} else {
+		auto it = files.find(FileSystem::GetKey(FileSystem::Combine(event.folderPath, event.name)));
+		if(it != files.end()) {
+			indices.insert(indices.end(), it->second.begin(), it->second.end());
+		}
+	}
+}
+
+void EntryIndex::FindTrees(Watcher::Event const& event, std::vector<TreeChange>& changes) const {
+	if(trees.empty()) {
+		return;
+	} else if(event.action == Watcher::Overflow && event.folderPath.empty()) {
+		// The watcher lost events for all folders.
+		for(size_t i : treeIndices) {
+			TreeChange change = { i, tstring() };
+			changes.push_back(change);
+		}
+		return;
+	}
+
+	// Look for the roots of trees among the folders containing the path.  A
+	// lost event for a folder means comparing it again.
+	tstring path = event.action == Watcher::Overflow ? event.folderPath : FileSystem::Combine(event.folderPath, event.name);
+	for(tstring folderPath = event.folderPath;;) {
+		auto it = trees.find(FileSystem::GetKey(folderPath));
+		if(it != trees.end()) {
+			// Skip the separator unless the root path ends with it.
+			size_t start = FileSystem::Combine(folderPath, tstring()).size();
+			tstring relativePath = start < path.size() ? path.substr(start) : tstring();
+			for(size_t i : it->second) {
+				TreeChange change = { i, relativePath };
+				changes.push_back(change);
+			}
+		}
+		tstring parentPath = FileSystem::GetFolder(folderPath);
+		if(parentPath.empty() || parentPath == folderPath) {
+			break;
+		}
+		folderPath.swap(parentPath);
+	}
+}
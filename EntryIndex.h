@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Entry.h"
+#include "Watcher.h"
+
+// This maps the files and folders of a set of entries to the entries that
+// involve them so a change event finds its entries without a scan.
+class EntryIndex
+{
+public:
+	EntryIndex() {}
+	void Build(std::vector<Entry> const& entries);
+	void Clear();
+	void Add(size_t i, Entry const& entry);
+
+	// A tree change is the path, relative to the roots of a tree entry, of
+	// a changed file or of a folder to compare again.  An empty path is the
+	// whole tree.
+	struct TreeChange
+	{
+		size_t index;
+		tstring relativePath;
+	};
+
+	// Append the indices of the file entries affected by an event.  The
+	// result might contain duplicates.
+	void Find(Watcher::Event const& event, std::vector<size_t>& indices) const;
+
+	// Append the changes of the tree entries affected by an event.
+	void FindTrees(Watcher::Event const& event, std::vector<TreeChange>& changes) const;
+
+private:
+	std::unordered_map<tstring, std::vector<size_t>> files, folders, trees;
+	std::vector<size_t> fileIndices, treeIndices;
+};
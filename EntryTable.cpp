@@ -0,0 +1,219 @@
+#include "stdafx.h"
+#include "EntryTable.h"
+
+void EntryTable::Build(std::vector<Entry> const& entries) {
+	Clear();
+	size_t count = entries.size();
+	lastWriteTimes1.reserve(count);
+	lastWriteTimes2.reserve(count);
+	devices1.reserve(count);
+	devices2.reserve(count);
+	flags.reserve(count);
+	paths1.reserve(count);
+	paths2.reserve(count);
+	for(auto const& entry : entries) {
+		lastWriteTimes1.push_back(entry.get_LastWriteTime1());
+		lastWriteTimes2.push_back(entry.get_LastWriteTime2());
+		devices1.push_back(entry.get_Device1());
+		devices2.push_back(entry.get_Device2());
+		flags.push_back(static_cast<unsigned char>(entry.get_Flags()));
+		paths1.push_back(arena.Add(entry.get_Path1()));
+		paths2.push_back(arena.Add(entry.get_Path2()));
+	}
+	arena.Seal();
+}
+
+void EntryTable::Clear() {
+	lastWriteTimes1.clear();
+	lastWriteTimes2.clear();
+	devices1.clear();
+	devices2.clear();
+	flags.clear();
+	paths1.clear();
+	paths2.clear();
+	arena.Clear();
+}
+
+void EntryTable::TakeState(size_t i, EntryTable const& that, size_t j) {
+	lastWriteTimes1[i] = that.lastWriteTimes1[j];
+	lastWriteTimes2[i] = that.lastWriteTimes2[j];
+	devices1[i] = that.devices1[j];
+	devices2[i] = that.devices2[j];
+}
+
+void EntryTable::SetInfo(size_t i, unsigned side, FileSystem::Info const* info) {
+	(side == 1 ? lastWriteTimes1 : lastWriteTimes2)[i] = info ? info->lastWriteTime : 0;
+	if(info) {
+		(side == 1 ? devices1 : devices2)[i] = info->device;
+	}
+}
+
+void EntryTable::ForgetNewerTime(size_t i) {
+	if(lastWriteTimes1[i] != lastWriteTimes2[i]) {
+		if(IsTwoWay(i) && lastWriteTimes2[i] > lastWriteTimes1[i]) {
+			lastWriteTimes2[i] = 0;
+		} else {
+			lastWriteTimes1[i] = 0;
+		}
+	}
+}
+
+EntryTable::State EntryTable::GetState(size_t i) const {
+	State state = { lastWriteTimes1[i], lastWriteTimes2[i], devices1[i], devices2[i] };
+	return state;
+}
+
+void EntryTable::SetState(size_t i, State const& state) {
+	lastWriteTimes1[i] = state.lastWriteTime1;
+	lastWriteTimes2[i] = state.lastWriteTime2;
+	devices1[i] = state.device1;
+	devices2[i] = state.device2;
+}
+
+bool EntryTable::Synchronize(size_t i, State& state, Copier& copier, std::vector<tstring>& deferredPaths, std::atomic<bool> const* isCancelled) const {
+	tstring path1 = get_Path1(i);
+	FileSystem::Info info;
+	if(FileSystem::GetInfo(path1, info)) {
+		FileSystem::Time lastWriteTime = info.lastWriteTime;
+		state.device1 = info.device;
+		if(state.lastWriteTime1 != lastWriteTime) {
+			// The main file changed.  Copy it to the other file.
+			Copier::Result result = copier.Copy(path1, get_Path2(i), isCancelled);
+			if(result == Copier::Deferred || result == Copier::Cancelled) {
+				// Keep the state so the next try sees the change.
+				if(result == Copier::Deferred) {
+					deferredPaths.push_back(path1);
+				}
+				return false;
+			}
+			state.lastWriteTime1 = state.lastWriteTime2 = lastWriteTime;
+			return result == Copier::Copied;
+		} else if(IsTwoWay(i)) {
+			tstring path2 = get_Path2(i);
+			if(FileSystem::GetInfo(path2, info)) {
+				lastWriteTime = info.lastWriteTime;
+				state.device2 = info.device;
+				if(state.lastWriteTime2 != lastWriteTime) {
+					// The other file changed.  Copy it to the main file.
+					Copier::Result result = copier.Copy(path2, path1, isCancelled);
+					if(result == Copier::Deferred || result == Copier::Cancelled) {
+						if(result == Copier::Deferred) {
+							deferredPaths.push_back(path2);
+						}
+						return false;
+					}
+					state.lastWriteTime1 = state.lastWriteTime2 = lastWriteTime;
+					return result == Copier::Copied;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+void EntryTable::SynchronizeGroup(std::vector<size_t> const& indices, std::vector<State>& states, Copier& copier, std::vector<tstring>& deferredPaths,
+	std::atomic<bool> const* isCancelled, std::vector<bool>& copied) const {
+	copied.assign(indices.size(), false);
+	tstring path1 = get_Path1(indices.front());
+	FileSystem::Info info;
+	if(!FileSystem::GetInfo(path1, info)) {
+		return;
+	}
+	std::vector<size_t> positions;
+	std::vector<tstring> destinationPaths;
+	for(size_t k = 0; k < indices.size(); ++k) {
+		states[k].device1 = info.device;
+		if(states[k].lastWriteTime1 != info.lastWriteTime) {
+			positions.push_back(k);
+			destinationPaths.push_back(get_Path2(indices[k]));
+		}
+	}
+	if(destinationPaths.empty()) {
+		return;
+	}
+	std::vector<Copier::Result> results;
+	copier.Copy(path1, destinationPaths, isCancelled, results);
+	bool isDeferred = false;
+	for(size_t j = 0; j < results.size(); ++j) {
+		if(results[j] == Copier::Deferred || results[j] == Copier::Cancelled) {
+			// Keep the state so the next try sees the change.
+			isDeferred = isDeferred || results[j] == Copier::Deferred;
+			continue;
+		}
+		State& state = states[positions[j]];
+		state.lastWriteTime1 = state.lastWriteTime2 = info.lastWriteTime;
+		copied[positions[j]] = results[j] == Copier::Copied;
+	}
+	if(isDeferred) {
+		deferredPaths.push_back(path1);
+	}
+}
+
+unsigned EntryTable::SynchronizeTree(size_t i, std::vector<tstring> const& relativePaths, Copier& copier, TreeWalker& walker,
+	std::vector<tstring>& folderPaths, std::vector<tstring>& deferredPaths) const {
+	tstring rootPath1 = get_Path1(i), rootPath2 = get_Path2(i);
+	bool isTwoWay = IsTwoWay(i);
+	std::vector<tstring> filePaths, relativeFolderPaths;
+	for(auto const& relativePath : relativePaths) {
+		FileSystem::Info info1, info2;
+		bool isFolder = relativePath.empty() || (FileSystem::GetInfo(TreeWalker::Resolve(rootPath1, relativePath), info1) && info1.isFolder)
+			|| (isTwoWay && FileSystem::GetInfo(TreeWalker::Resolve(rootPath2, relativePath), info2) && info2.isFolder);
+		if(isFolder) {
+			walker.Compare(rootPath1, rootPath2, relativePath, isTwoWay, filePaths, relativeFolderPaths);
+		} else {
+			filePaths.push_back(relativePath);
+		}
+	}
+
+	// Copy the files before watching the folders so the folders exist on
+	// both sides.
+	unsigned copyCount = 0;
+	for(auto const& relativePath : filePaths) {
+		if(SynchronizeFile(rootPath1, rootPath2, relativePath, isTwoWay, copier, deferredPaths)) {
+			++copyCount;
+		}
+	}
+	for(auto const& relativePath : relativeFolderPaths) {
+		tstring folderPath1 = TreeWalker::Resolve(rootPath1, relativePath), folderPath2 = TreeWalker::Resolve(rootPath2, relativePath);
+		FileSystem::CreateFolders(folderPath2);
+		folderPaths.push_back(folderPath1);
+		if(isTwoWay) {
+			FileSystem::CreateFolders(folderPath1);
+			folderPaths.push_back(folderPath2);
+		}
+	}
+	return copyCount;
+}
+
+// Copy one file of a tree to the other side if the sides differ.  The newer
+// side wins in a two-way tree.
+bool EntryTable::SynchronizeFile(tstring const& rootPath1, tstring const& rootPath2, tstring const& relativePath, bool isTwoWay, Copier& copier,
+	std::vector<tstring>& deferredPaths) {
+	tstring path1 = TreeWalker::Resolve(rootPath1, relativePath), path2 = TreeWalker::Resolve(rootPath2, relativePath);
+	FileSystem::Info info1, info2;
+	bool hasFile1 = FileSystem::GetInfo(path1, info1) && !info1.isFolder;
+	bool hasFile2 = FileSystem::GetInfo(path2, info2) && !info2.isFolder;
+	tstring const* sourcePath;
+	tstring const* destinationPath;
+	if(hasFile1 && (!hasFile2 || (info1.lastWriteTime != info2.lastWriteTime && (!isTwoWay || info1.lastWriteTime > info2.lastWriteTime)))) {
+		sourcePath = &path1;
+		destinationPath = &path2;
+	} else if(isTwoWay && hasFile2 && (!hasFile1 || info2.lastWriteTime > info1.lastWriteTime)) {
+		sourcePath = &path2;
+		destinationPath = &path1;
+	} else {
+		return false;
+	}
+	FileSystem::CreateFolders(FileSystem::GetFolder(*destinationPath));
+	Copier::Result result = copier.Copy(*sourcePath, *destinationPath, nullptr);
+	if(result == Copier::Deferred) {
+		deferredPaths.push_back(*sourcePath);
+	}
+	return result == Copier::Copied;
+}
+
+size_t EntryTable::get_Size() const {
+	return (lastWriteTimes1.capacity() + lastWriteTimes2.capacity()) * sizeof(FileSystem::Time)
+		+ (devices1.capacity() + devices2.capacity()) * sizeof(FileSystem::Device) + flags.capacity()
+		+ (paths1.capacity() + paths2.capacity()) * sizeof(PathArena::Path) + arena.get_Size();
+}
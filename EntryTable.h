@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Copier.h"
+#include "Entry.h"
+#include "PathArena.h"
+#include "TreeWalker.h"
+
+// An entry table holds entries as a structure of arrays.  The state change
+// detection reads is packed in arrays of its own and the paths live in an
+// arena, so a pass over the entries touches only the state it needs.
+//
+// The paths and flags never change after Build, so workers share a table
+// without locks through its const synchronization methods, which take the
+// state of their entry by reference.  One thread owns the state arrays.
+class EntryTable
+{
+public:
+	// This is the state of an entry, the last write times and devices of
+	// its files.
+	struct State
+	{
+		FileSystem::Time lastWriteTime1, lastWriteTime2;
+		FileSystem::Device device1, device2;
+	};
+
+	EntryTable() {}
+	void Build(std::vector<Entry> const& entries);
+	void Clear();
+	size_t get_Count() const { return lastWriteTimes1.size(); }
+
+	tstring get_Path1(size_t i) const { return arena.Get(paths1[i]); }
+	tstring get_Path2(size_t i) const { return arena.Get(paths2[i]); }
+	FileSystem::Time get_LastWriteTime1(size_t i) const { return lastWriteTimes1[i]; }
+	FileSystem::Time get_LastWriteTime2(size_t i) const { return lastWriteTimes2[i]; }
+	FileSystem::Device get_Device1(size_t i) const { return devices1[i]; }
+	FileSystem::Device get_Device2(size_t i) const { return devices2[i]; }
+	bool IsTwoWay(size_t i) const { return (flags[i] & Entry::TwoWay) != 0; }
+	bool IsTree(size_t i) const { return (flags[i] & Entry::Tree) != 0; }
+	State GetState(size_t i) const;
+	void SetState(size_t i, State const& state);
+
+	// Keep the last write times of an entry of another table for the same
+	// files so replacing the entries does not look like a change.
+	void TakeState(size_t i, EntryTable const& that, size_t j);
+
+	// Record the state of a file, on side one or two, of an entry whose
+	// state was collected after building the table.  A missing file has no
+	// time.
+	void SetInfo(size_t i, unsigned side, FileSystem::Info const* info);
+
+	// Forget the time of the newer file of an entry, or of the main file of
+	// a one-way entry, so synchronizing copies it.  The engine calls this for
+	// an entry that changed before its state was collected.
+	void ForgetNewerTime(size_t i);
+
+	// Copy whichever file of an entry changed since its state to the other
+	// one and update the state.  Return whether it copied any contents.
+	// Append the source if the copier deferred its copy.  Stop the copy once
+	// the flag, if given, is set.  Workers call this concurrently for
+	// different entries.
+	bool Synchronize(size_t i, State& state, Copier& copier, std::vector<tstring>& deferredPaths, std::atomic<bool> const* isCancelled) const;
+
+	// Copy the main file shared by one-way file entries to those whose
+	// states lack its last write time, reading it once, and update their
+	// states.  Append the main file if the copier deferred the copies and
+	// get whether each entry's file was copied.
+	void SynchronizeGroup(std::vector<size_t> const& indices, std::vector<State>& states, Copier& copier, std::vector<tstring>& deferredPaths,
+		std::atomic<bool> const* isCancelled, std::vector<bool>& copied) const;
+
+	// Synchronize the changed paths of a tree entry.  Compare the folders
+	// among them, or the whole tree for an empty path, with the walker and
+	// mirror their folders.  Get the folders to watch and the sources of
+	// deferred copies.  Return the number of files copied.
+	unsigned SynchronizeTree(size_t i, std::vector<tstring> const& relativePaths, Copier& copier, TreeWalker& walker,
+		std::vector<tstring>& folderPaths, std::vector<tstring>& deferredPaths) const;
+
+	// Get the number of bytes the table uses.
+	size_t get_Size() const;
+
+private:
+	std::vector<FileSystem::Time> lastWriteTimes1, lastWriteTimes2;
+	std::vector<FileSystem::Device> devices1, devices2;
+	std::vector<unsigned char> flags;
+	std::vector<PathArena::Path> paths1, paths2;
+	PathArena arena;
+
+	static bool SynchronizeFile(tstring const& rootPath1, tstring const& rootPath2, tstring const& relativePath, bool isTwoWay, Copier& copier,
+		std::vector<tstring>& deferredPaths);
+
+	EntryTable(EntryTable const&); // undefined
+	EntryTable& operator=(EntryTable const&); // undefined
+};
@@ -0,0 +1,49 @@
+#include "stdafx.h"
+#include "EventQueue.h"
+
+EventQueue::EventQueue(size_t capacity) : head(0), tail(0) {
+	size_t size = 2;
+	while(size < capacity) {
+		size *= 2;
+	}
+	cells.reset(new Cell[size]);
+	mask = size - 1;
+	for(size_t i = 0; i < size; ++i) {
+		cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+}
+
+bool EventQueue::TryPush(Watcher::Event&& event) {
+	size_t position = head.load(std::memory_order_relaxed);
+	Cell* cell;
+	for(;;) {
+		cell = &cells[position & mask];
+		size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		if(sequence == position) {
+			// The cell is free.  Claim it unless another producer did.
+			if(head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if(sequence < position) {
+			// The consumer has not yet taken the cell's previous event.
+			return false;
+		} else {
+			// Another producer claimed the cell.
+			position = head.load(std::memory_order_relaxed);
+		}
+	}
+	cell->event = std::move(event);
+	cell->sequence.store(position + 1, std::memory_order_release);
+	return true;
+}
+
+bool EventQueue::TryPop(Watcher::Event& event) {
+	Cell& cell = cells[tail & mask];
+	if(cell.sequence.load(std::memory_order_acquire) != tail + 1) {
+		return false;
+	}
+	event = std::move(cell.event);
+	cell.sequence.store(tail + mask + 1, std::memory_order_release);
+	++tail;
+	return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Watcher.h"
+
+// An event queue passes change events from any number of producer threads
+// to one consumer thread without locks.  It holds a fixed number of events,
+// so a burst cannot grow it, and TryPush fails when it is full.  Each cell
+// has a sequence number telling whose turn it is: a producer claims a cell
+// by advancing the head and then publishes it by advancing the sequence.
+class EventQueue
+{
+public:
+	// Round the capacity up to a power of two.
+	explicit EventQueue(size_t capacity);
+
+	// Producers may call this concurrently.  It leaves the event alone if
+	// the queue is full.
+	bool TryPush(Watcher::Event&& event);
+
+	// Only the consumer calls this.
+	bool TryPop(Watcher::Event& event);
+
+	size_t get_Capacity() const { return mask + 1; }
+
+private:
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		Watcher::Event event;
+	};
+
+	std::unique_ptr<Cell[]> cells;
+	size_t mask;
+
+	// Keep the producers' and the consumer's positions on separate cache
+	// lines.
+	char padding1[64];
+	std::atomic<size_t> head;
+	char padding2[64 - sizeof(std::atomic<size_t>)];
+	size_t tail;
+
+	EventQueue(EventQueue const&); // undefined
+	EventQueue& operator=(EventQueue const&); // undefined
+};
@@ -1,19 +1,19 @@
 #include "stdafx.h"
 #include "FileSync.h"
+#include "Batch.h"
 #include "Dialog.h"
 #include "Entry.h"
+#include "Settings.h"
+#include "SyncEngine.h"
 
 HINSTANCE g_instance;
 
-static LPCTSTR const applicationDataFolderParts[] = { _T("Adrezdi"), _T("FileSync") };
-static LPCTSTR const applicationDataPath = _T("Adrezdi\\FileSync\\Settings.txt");
 static UINT const WM_CLIPBOARD_CHANGED = WM_USER;
 static UINT const WM_STATUS_NOTIFY = WM_CLIPBOARD_CHANGED + 1;
 static UINT const WM_SHOW_ICON = WM_STATUS_NOTIFY + 1;
 
 static std::vector<Entry> entries;
-static std::set<tstring> folderPaths;
-static HANDLE signal, port, thread;
+static SyncEngine engine;
 static UINT taskbarCreatedMessageId;
 static bool enabled;
 
@@ -21,82 +21,29 @@ static void LoadSettings() {
 	// Delete the current entries.
 	entries.clear();
 
-	// Create new entries from the roaming user profile application data folder.
-	TCHAR path[MAX_PATH];
-	if(SUCCEEDED(SHGetFolderPath(NULL, CSIDL_APPDATA, NULL, 0, path))) {
-		if(PathAppend(path, applicationDataPath)) {
-			FILE* fin;
-			if(_tfopen_s(&fin, path, _T("rt")) == 0) {
-				for(int i = 0; _fgetts(path, MAX_PATH, fin) != nullptr; ++i) {
-					Entry entry;
-					if(!entry.CreateFromString(path)) {
-						break;
-					}
-					entry.AddFolder(folderPaths);
-					entries.push_back(entry);
-				}
-				fclose(fin);
-			}
+	// Create new entries from the settings store.
+	tstring path = Settings::GetPath(false);
+	if(!path.empty() && !Settings::Load(path, entries)) {
+		// Import the text settings file of earlier versions.
+		tstring textPath = Settings::GetTextPath();
+		if(Settings::Load(textPath, entries) && !entries.empty()) {
+			Settings::Save(path, entries);
 		}
 	}
 }
 
 static void SaveSettings() {
-	TCHAR path[MAX_PATH];
-	if(SUCCEEDED(SHGetFolderPath(NULL, CSIDL_APPDATA, NULL, 0, path))) {
-		for(auto* folderPart : applicationDataFolderParts) {
-			if(!PathAppend(path, folderPart)) {
-				return;
-			}
-			if(_tmkdir(path) != 0 && errno != EEXIST) {
-				return;
-			}
-		}
-		if(PathAppend(path, _T("Settings.txt"))) {
-			FILE* fout;
-			if(_tfopen_s(&fout, path, _T("wt")) == 0) {
-				folderPaths.clear();
-				for(int i = 0; i < (int)entries.size(); ++i) {
-					entries[i].SaveToFile(fout);
-					entries[i].AddFolder(folderPaths);
-				}
-				fclose(fout);
-			}
-		}
+	tstring path = Settings::GetPath(true);
+	if(!path.empty()) {
+		Settings::Save(path, entries);
 	}
 }
 
-static DWORD WINAPI WatchForChanges(HWND /*window*/) {
-	for(;;) {
-		// Collect the signal and all folders.
-		HANDLE handles[MAXIMUM_WAIT_OBJECTS] = { signal };
-		HANDLE* p = handles;
-		for(auto& folderPath : folderPaths) {
-			*++p = FindFirstChangeNotification(folderPath.c_str(), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE);
-		}
-
-		// Wait for a signal or a folder change.
-		DWORD result = WaitForMultipleObjects(p - handles + 1, handles, FALSE, INFINITE);
-
-		// Close all folder change notification handles.
-		while(p > handles) {
-			FindCloseChangeNotification(*p--);
-		}
-
-		// Respond to what happened.
-		if(result == WAIT_OBJECT_0) {
-			// signal
-			DWORD n, key;
-			LPOVERLAPPED po;
-			while(GetQueuedCompletionStatus(port, &n, &key, &po, 0)) {
-				if(n != 0) {
-					return PostThreadMessage(n, WM_QUIT, 0, 0);
-				}
-			}
-		} else if(result != WAIT_FAILED && enabled) {
-			// change
-			std::for_each(entries.begin(), entries.end(), std::mem_fun_ref(&Entry::Synchronize));
-		}
+// Record only the entries the user changed.
+static void UpdateSettings(std::vector<Entry> const& previousEntries) {
+	tstring path = Settings::GetPath(true);
+	if(!path.empty()) {
+		Settings::Update(path, previousEntries, entries);
 	}
 }
 
@@ -189,10 +136,8 @@ static LRESULT CALLBACK WindowProcedure(HWND window, UINT messageId, WPARAM wPar
 				return -1;
 			}
 		}
-		signal = CreateEvent(NULL, FALSE, FALSE, NULL);
-		port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
 		AddStatusAreaIcon(window);
-		thread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)WatchForChanges, window, 0, NULL);
+		engine.Start(entries);
 		break;
 	case WM_COMMAND:
 		switch(LOWORD(wParam)) {
@@ -200,13 +145,17 @@ static LRESULT CALLBACK WindowProcedure(HWND window, UINT messageId, WPARAM wPar
 			RemoveStatusAreaIcon(window);
 			break;
 		case IDM_SELECT:
-			if(Dialog::SelectFiles(window, entries)) {
-				SaveSettings();
-				SetEvent(signal);
+			{
+				std::vector<Entry> previousEntries = entries;
+				if(Dialog::SelectFiles(window, entries)) {
+					UpdateSettings(previousEntries);
+					engine.SetEntries(entries);
+				}
 			}
 			break;
 		case IDM_ENABLE:
 			enabled = !enabled;
+			engine.Enable(enabled);
 			UpdateStatusAreaIcon(window);
 			break;
 		case IDM_ABOUT:
@@ -222,17 +171,15 @@ static LRESULT CALLBACK WindowProcedure(HWND window, UINT messageId, WPARAM wPar
 		break;
 	case WM_SHOW_ICON:
 		enabled = true;
+		engine.Enable(enabled);
 		AddStatusAreaIcon(window);
 		LoadSettings();
+		engine.SetEntries(entries);
 		break;
 	case WM_DESTROY:
-		if(thread != NULL) {
-			RemoveStatusAreaIcon(window);
-			PostQueuedCompletionStatus(port, GetCurrentThreadId(), 0, NULL);
-			SetEvent(signal);
-		} else {
-			PostQuitMessage(0);
-		}
+		RemoveStatusAreaIcon(window);
+		engine.Stop();
+		PostQuitMessage(0);
 		break;
 	default:
 		if(messageId == taskbarCreatedMessageId) {
@@ -244,8 +191,36 @@ static LRESULT CALLBACK WindowProcedure(HWND window, UINT messageId, WPARAM wPar
 	return 0;
 }
 
-int APIENTRY _tWinMain(HINSTANCE instance, HINSTANCE /*previousInstance*/, LPTSTR /*commandLine*/, int /*showCommand*/) {
+// Synchronize every entry once for scripts and scheduled tasks.  Print the
+// result of each to the console of the caller, if any, and return 0 if all
+// entries match, 1 if there are none, or 3 if any failed or lacks its main
+// file.
+static int RunOnce() {
+	LoadSettings();
+	if(entries.empty()) {
+		return 1;
+	}
+	Batch batch;
+	std::vector<Batch::Result> results;
+	bool succeeded = batch.Run(entries, results);
+	FILE* fout = AttachConsole(ATTACH_PARENT_PROCESS) ? _tfopen(_T("CONOUT$"), _T("w")) : NULL;
+	if(fout != NULL) {
+		for(size_t i = 0; i < entries.size(); ++i) {
+			_ftprintf(fout, _T("%hs\t%u\t%s\t%s\n"), Batch::GetStatusName(results[i].status), results[i].copyCount, entries[i].get_Path1().c_str(),
+				entries[i].get_Path2().c_str());
+		}
+		fclose(fout);
+	}
+	return succeeded ? 0 : 3;
+}
+
+int APIENTRY _tWinMain(HINSTANCE instance, HINSTANCE /*previousInstance*/, LPTSTR commandLine, int /*showCommand*/) {
 	g_instance = instance;
+
+	// Run without the status area icon for the one-shot switch.
+	if(lstrcmpi(commandLine, _T("/once")) == 0) {
+		return RunOnce();
+	}
 	taskbarCreatedMessageId = RegisterWindowMessage(_T("TaskbarCreated"));
 
 	// Initialize the common controls to get the new theme.
@@ -289,7 +264,5 @@ int APIENTRY _tWinMain(HINSTANCE instance, HINSTANCE /*previousInstance*/, LPTST
 		DispatchMessage(&messageId);
 	}
 
-	CloseHandle(signal);
-	CloseHandle(port);
 	return (int)messageId.wParam;
 }
@@ -0,0 +1,633 @@
+#include "stdafx.h"
+#include "FileSystem.h"
+
+#ifdef _WIN32
+static TCHAR const separator = _T('\\');
+#else
+static TCHAR const separator = _T('/');
+#endif
+
+tstring FileSystem::GetKey(tstring const& path) {
+#ifdef _WIN32
+	tstring key = path;
+	if(!key.empty()) {
+		CharLowerBuff(&key[0], static_cast<DWORD>(key.size()));
+	}
+	return key;
+#else
+	return path;
+#endif
+}
+
+tstring FileSystem::GetFolder(tstring const& filePath) {
+	tstring::size_type i = filePath.find_last_of(separator);
+	if(i == tstring::npos) {
+		return tstring();
+	}
+
+	// Keep the separator of a root folder.
+	return filePath.substr(0, i == 0 || (i == 2 && filePath[1] == _T(':')) ? i + 1 : i);
+}
+
+tstring FileSystem::GetName(tstring const& filePath) {
+	tstring::size_type i = filePath.find_last_of(separator);
+	return i == tstring::npos ? filePath : filePath.substr(i + 1);
+}
+
+tstring FileSystem::Combine(tstring const& folderPath, tstring const& name) {
+	if(folderPath.empty() || folderPath.back() == separator) {
+		return folderPath + name;
+	}
+	return folderPath + separator + name;
+}
+
+static TCHAR const temporarySuffix[] = _T(".filesync-partial");
+
+tstring FileSystem::GetTemporaryPath(tstring const& filePath) {
+	return filePath + temporarySuffix;
+}
+
+bool FileSystem::IsTemporary(tstring const& name) {
+	size_t length = _countof(temporarySuffix) - 1;
+	return name.size() > length && name.compare(name.size() - length, length, temporarySuffix) == 0;
+}
+
+bool FileSystem::GetTime(tstring const& filePath, Time& lastWriteTime) {
+	Info info;
+	if(GetInfo(filePath, info)) {
+		lastWriteTime = info.lastWriteTime;
+		return true;
+	}
+	return false;
+}
+
+bool FileSystem::Copy(tstring const& sourcePath, tstring const& destinationPath, bool failIfExists) {
+	CopyMethod method;
+	return Copy(sourcePath, destinationPath, failIfExists, method, Progress());
+}
+
+bool FileSystem::File::Open(tstring const& filePath, Mode mode) {
+	return Open(filePath, mode, false);
+}
+
+#ifdef _WIN32
+bool FileSystem::GetInfo(tstring const& filePath, Info& info) {
+	WIN32_FILE_ATTRIBUTE_DATA fad;
+	if(GetFileAttributesEx(filePath.c_str(), GetFileExInfoStandard, &fad)) {
+		info.lastWriteTime = (Time)fad.ftLastWriteTime.dwHighDateTime << 32 | fad.ftLastWriteTime.dwLowDateTime;
+		info.size = (unsigned long long)fad.nFileSizeHigh << 32 | fad.nFileSizeLow;
+
+		// Use the drive number to avoid opening the file.
+		info.device = PathGetDriveNumber(filePath.c_str()) + 1;
+		info.fileId = 0;
+		info.isFolder = (fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+		return true;
+	}
+	return false;
+}
+
+bool FileSystem::ListFolder(tstring const& folderPath, std::vector<Item>& items) {
+	WIN32_FIND_DATA data;
+	HANDLE handle = FindFirstFileEx(Combine(folderPath, _T("*")).c_str(), FindExInfoBasic, &data, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+	if(handle == INVALID_HANDLE_VALUE) {
+		return GetLastError() == ERROR_FILE_NOT_FOUND;
+	}
+	Device device = PathGetDriveNumber(folderPath.c_str()) + 1;
+	do {
+		if(_tcscmp(data.cFileName, _T(".")) == 0 || _tcscmp(data.cFileName, _T("..")) == 0 || (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+			continue;
+		}
+		Item item;
+		item.name = data.cFileName;
+		item.info.lastWriteTime = (Time)data.ftLastWriteTime.dwHighDateTime << 32 | data.ftLastWriteTime.dwLowDateTime;
+		item.info.size = (unsigned long long)data.nFileSizeHigh << 32 | data.nFileSizeLow;
+		item.info.device = device;
+		item.info.fileId = 0;
+		item.info.isFolder = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+		items.push_back(item);
+	} while(FindNextFile(handle, &data));
+	bool succeeded = GetLastError() == ERROR_NO_MORE_FILES;
+	FindClose(handle);
+	return succeeded;
+}
+
+void FileSystem::GetInfos(tstring const& folderPath, std::vector<tstring> const& names, std::vector<Info>& infos, std::vector<bool>& found) {
+	infos.assign(names.size(), Info());
+	found.assign(names.size(), false);
+	for(size_t i = 0; i < names.size(); ++i) {
+		found[i] = GetInfo(Combine(folderPath, names[i]), infos[i]);
+	}
+}
+
+FileSystem::File::File() : handle(INVALID_HANDLE_VALUE), isUnbuffered(false) {}
+
+bool FileSystem::File::Open(tstring const& filePath, Mode mode, bool unbuffered) {
+	Close();
+	DWORD access = mode == ReadOnly ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE;
+	DWORD disposition = mode == Create ? CREATE_ALWAYS : OPEN_EXISTING;
+	DWORD flags = FILE_ATTRIBUTE_NORMAL | (unbuffered ? FILE_FLAG_NO_BUFFERING : 0);
+	handle = CreateFile(filePath.c_str(), access, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, disposition, flags, NULL);
+	isUnbuffered = unbuffered;
+	return handle != INVALID_HANDLE_VALUE;
+}
+
+bool FileSystem::File::Close() {
+	bool succeeded = true;
+	if(handle != INVALID_HANDLE_VALUE) {
+		succeeded = !!CloseHandle(handle);
+		handle = INVALID_HANDLE_VALUE;
+	}
+	return succeeded;
+}
+
+bool FileSystem::File::IsOpen() const {
+	return handle != INVALID_HANDLE_VALUE;
+}
+
+long long FileSystem::File::Read(unsigned long long offset, void* buffer, size_t size) {
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = static_cast<DWORD>(offset);
+	overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+	DWORD n;
+	if(!ReadFile(handle, buffer, static_cast<DWORD>(size), &n, &overlapped)) {
+		return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+	}
+	return n;
+}
+
+bool FileSystem::File::Write(unsigned long long offset, void const* buffer, size_t size) {
+	OVERLAPPED overlapped = {};
+	overlapped.Offset = static_cast<DWORD>(offset);
+	overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+	DWORD n;
+	return WriteFile(handle, buffer, static_cast<DWORD>(size), &n, &overlapped) && n == size;
+}
+
+bool FileSystem::File::GetInfo(Info& info) {
+	BY_HANDLE_FILE_INFORMATION information;
+	if(!GetFileInformationByHandle(handle, &information)) {
+		return false;
+	}
+	info.lastWriteTime = (Time)information.ftLastWriteTime.dwHighDateTime << 32 | information.ftLastWriteTime.dwLowDateTime;
+	info.size = (unsigned long long)information.nFileSizeHigh << 32 | information.nFileSizeLow;
+
+	// GetInfo identifies devices by drive number, which a handle does not
+	// reveal.
+	info.device = 0;
+	info.fileId = (unsigned long long)information.nFileIndexHigh << 32 | information.nFileIndexLow;
+	info.isFolder = (information.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+	return true;
+}
+
+bool FileSystem::File::SetSize(unsigned long long size) {
+	LARGE_INTEGER distance;
+	distance.QuadPart = size;
+	return SetFilePointerEx(handle, distance, NULL, FILE_BEGIN) && SetEndOfFile(handle);
+}
+
+bool FileSystem::File::SetTime(Time lastWriteTime) {
+	FILETIME ft;
+	ft.dwLowDateTime = static_cast<DWORD>(lastWriteTime);
+	ft.dwHighDateTime = static_cast<DWORD>(lastWriteTime >> 32);
+	return !!SetFileTime(handle, NULL, NULL, &ft);
+}
+
+// CopyFileEx reports the bytes transferred so far, so this remembers them
+// to report each chunk's.
+struct CopyProgress
+{
+	FileSystem::Progress const& progress;
+	unsigned long long transferred;
+};
+
+static DWORD CALLBACK ReportProgress(LARGE_INTEGER /*totalSize*/, LARGE_INTEGER transferred, LARGE_INTEGER /*streamSize*/,
+	LARGE_INTEGER /*streamTransferred*/, DWORD /*streamNumber*/, DWORD /*reason*/, HANDLE /*source*/, HANDLE /*destination*/, LPVOID data) {
+	CopyProgress* copyProgress = static_cast<CopyProgress*>(data);
+	unsigned long long size = transferred.QuadPart - copyProgress->transferred;
+	copyProgress->transferred = transferred.QuadPart;
+	return copyProgress->progress(size) ? PROGRESS_CONTINUE : PROGRESS_CANCEL;
+}
+
+bool FileSystem::Copy(tstring const& sourcePath, tstring const& destinationPath, bool failIfExists, CopyMethod& method, Progress const& progress) {
+	// CopyFileEx chooses its own method, including block cloning on ReFS, and
+	// calls the progress routine after each chunk.
+	method = Native;
+	CopyProgress copyProgress = { progress, 0 };
+	return !!CopyFileEx(sourcePath.c_str(), destinationPath.c_str(), progress ? ReportProgress : NULL, &copyProgress, NULL,
+		failIfExists ? COPY_FILE_FAIL_IF_EXISTS : 0);
+}
+
+bool FileSystem::LowerIoPriority() {
+	// Background mode also gives the thread very low I/O priority.
+	return !!SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+}
+
+bool FileSystem::Replace(tstring const& sourcePath, tstring const& destinationPath) {
+	return !!MoveFileEx(sourcePath.c_str(), destinationPath.c_str(), MOVEFILE_REPLACE_EXISTING);
+}
+
+bool FileSystem::Delete(tstring const& filePath) {
+	return !!DeleteFile(filePath.c_str());
+}
+
+bool FileSystem::IsRotational(Device /*device*/) {
+	return false;
+}
+
+bool FileSystem::HasChangeNotifications(tstring const& folderPath) {
+	TCHAR volumePath[MAX_PATH];
+	return !GetVolumePathName(folderPath.c_str(), volumePath, _countof(volumePath)) || GetDriveType(volumePath) != DRIVE_REMOTE;
+}
+
+// Opening the file without sharing write access fails if another handle
+// has it.
+bool FileSystem::HasWriters(tstring const& filePath, bool& hasWriters) {
+	HANDLE file = CreateFile(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+	if(file == INVALID_HANDLE_VALUE) {
+		hasWriters = true;
+		return GetLastError() == ERROR_SHARING_VIOLATION;
+	}
+	CloseHandle(file);
+	hasWriters = false;
+	return true;
+}
+
+bool FileSystem::CreateFolders(tstring const& folderPath) {
+	int result = SHCreateDirectoryEx(NULL, folderPath.c_str(), NULL);
+	return result == ERROR_SUCCESS || result == ERROR_ALREADY_EXISTS || result == ERROR_FILE_EXISTS;
+}
+#else
+static FileSystem::Time ToTime(struct timespec const& ts) {
+	return (FileSystem::Time)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void ToInfo(struct stat const& st, FileSystem::Info& info) {
+	info.lastWriteTime = ToTime(st.st_mtim);
+	info.size = st.st_size;
+	info.device = st.st_dev;
+	info.fileId = st.st_ino;
+	info.isFolder = S_ISDIR(st.st_mode);
+}
+
+bool FileSystem::GetInfo(tstring const& filePath, Info& info) {
+	struct stat st;
+	if(stat(filePath.c_str(), &st) == 0) {
+		ToInfo(st, info);
+		return true;
+	}
+	return false;
+}
+
+bool FileSystem::ListFolder(tstring const& folderPath, std::vector<Item>& items) {
+	int fd = open(folderPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(fd < 0) {
+		return false;
+	}
+	DIR* folder = fdopendir(fd);
+	if(folder == nullptr) {
+		close(fd);
+		return false;
+	}
+	errno = 0;
+	for(struct dirent* entry; (entry = readdir(folder)) != nullptr; errno = 0) {
+		if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+			continue;
+		}
+		struct stat st;
+		if(fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !(S_ISREG(st.st_mode) || S_ISDIR(st.st_mode))) {
+			continue;
+		}
+		Item item;
+		item.name = entry->d_name;
+		ToInfo(st, item.info);
+		items.push_back(item);
+	}
+	bool succeeded = errno == 0;
+	closedir(folder);
+	return succeeded;
+}
+
+void FileSystem::GetInfos(tstring const& folderPath, std::vector<tstring> const& names, std::vector<Info>& infos, std::vector<bool>& found) {
+	infos.assign(names.size(), Info());
+	found.assign(names.size(), false);
+
+	// Look up the names relative to the open folder so the kernel resolves
+	// its path once.
+	int fd = open(folderPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if(fd < 0) {
+		return;
+	}
+	for(size_t i = 0; i < names.size(); ++i) {
+		struct stat st;
+		if(fstatat(fd, names[i].c_str(), &st, 0) == 0) {
+			ToInfo(st, infos[i]);
+			found[i] = true;
+		}
+	}
+	close(fd);
+}
+
+FileSystem::File::File() : fd(-1), isUnbuffered(false) {}
+
+bool FileSystem::File::Open(tstring const& filePath, Mode mode, bool unbuffered) {
+	Close();
+	int flags = mode == ReadOnly ? O_RDONLY : mode == ReadWrite ? O_RDWR : O_RDWR | O_CREAT | O_TRUNC;
+	isUnbuffered = false;
+	if(unbuffered) {
+		fd = open(filePath.c_str(), flags | O_CLOEXEC | O_DIRECT, 0666);
+		if(fd >= 0) {
+			isUnbuffered = true;
+			return true;
+		} else if(errno != EINVAL) {
+			return false;
+		}
+
+		// The file system does not support direct I/O.
+	}
+	fd = open(filePath.c_str(), flags | O_CLOEXEC, 0666);
+	return fd >= 0;
+}
+
+bool FileSystem::File::Close() {
+	bool succeeded = true;
+	if(fd >= 0) {
+		succeeded = close(fd) == 0;
+		fd = -1;
+	}
+	return succeeded;
+}
+
+bool FileSystem::File::IsOpen() const {
+	return fd >= 0;
+}
+
+long long FileSystem::File::Read(unsigned long long offset, void* buffer, size_t size) {
+	for(;;) {
+		ssize_t n = pread(fd, buffer, size, offset);
+		if(n >= 0 || errno != EINTR) {
+			return n;
+		}
+	}
+}
+
+bool FileSystem::File::Write(unsigned long long offset, void const* buffer, size_t size) {
+	char const* p = static_cast<char const*>(buffer);
+	while(size > 0) {
+		ssize_t n = pwrite(fd, p, size, offset);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		p += n;
+		offset += n;
+		size -= n;
+	}
+	return true;
+}
+
+bool FileSystem::File::GetInfo(Info& info) {
+	struct stat st;
+	if(fstat(fd, &st) == 0) {
+		ToInfo(st, info);
+		return true;
+	}
+	return false;
+}
+
+bool FileSystem::File::SetSize(unsigned long long size) {
+	return ftruncate(fd, size) == 0;
+}
+
+bool FileSystem::File::SetTime(Time lastWriteTime) {
+	struct timespec times[2] = { { 0, UTIME_OMIT }, { static_cast<time_t>(lastWriteTime / 1000000000), static_cast<long>(lastWriteTime % 1000000000) } };
+	return futimens(fd, times) == 0;
+}
+
+static bool WriteAll(int fd, char const* p, size_t n) {
+	while(n > 0) {
+		ssize_t written = write(fd, p, n);
+		if(written < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		p += written;
+		n -= written;
+	}
+	return true;
+}
+
+// These errors mean the kernel cannot use a copy method for these files, so
+// try the next one.
+static bool IsUnsupported(int error) {
+	return error == ENOSYS || error == EXDEV || error == EINVAL || error == EOPNOTSUPP || error == ENOTSUP || error == EBADF;
+}
+
+// The copy methods report their progress after each chunk.
+static size_t const chunkSize = 8 << 20;
+
+static bool Continue(FileSystem::Progress const& progress, ssize_t size) {
+	return !progress || progress(size);
+}
+
+// Copy the rest of the file starting at offset in the kernel.  Return 1 if
+// it copied, 0 if the method is unsupported, or -1 on failure.
+static int CopyInKernel(int source, int destination, off_t& offset, FileSystem::Progress const& progress) {
+	for(;;) {
+		off_t sourceOffset = offset, destinationOffset = offset;
+		ssize_t n = copy_file_range(source, &sourceOffset, destination, &destinationOffset, chunkSize, 0);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return offset == 0 && IsUnsupported(errno) ? 0 : -1;
+		} else if(n == 0) {
+			return 1;
+		}
+		offset += n;
+		if(!Continue(progress, n)) {
+			return -1;
+		}
+	}
+}
+
+static int CopyWithSendFile(int source, int destination, off_t& offset, FileSystem::Progress const& progress) {
+	if(lseek(destination, offset, SEEK_SET) < 0) {
+		return -1;
+	}
+	for(;;) {
+		off_t sourceOffset = offset;
+		ssize_t n = sendfile(destination, source, &sourceOffset, chunkSize);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return IsUnsupported(errno) ? 0 : -1;
+		} else if(n == 0) {
+			return 1;
+		}
+		offset += n;
+		if(!Continue(progress, n)) {
+			return -1;
+		}
+	}
+}
+
+static bool CopyBuffered(int source, int destination, off_t offset, FileSystem::Progress const& progress) {
+	if(lseek(destination, offset, SEEK_SET) < 0) {
+		return false;
+	}
+	std::vector<char> buffer(1 << 20);
+	for(;;) {
+		ssize_t n = pread(source, &buffer[0], buffer.size(), offset);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return false;
+		} else if(n == 0) {
+			return true;
+		} else if(!WriteAll(destination, &buffer[0], n) || !Continue(progress, n)) {
+			return false;
+		}
+		offset += n;
+	}
+}
+
+bool FileSystem::Copy(tstring const& sourcePath, tstring const& destinationPath, bool failIfExists, CopyMethod& method, Progress const& progress) {
+	int source = open(sourcePath.c_str(), O_RDONLY | O_CLOEXEC);
+	if(source < 0) {
+		return false;
+	}
+	struct stat st;
+	if(fstat(source, &st) != 0) {
+		close(source);
+		return false;
+	}
+	int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | (failIfExists ? O_EXCL : 0);
+	int destination = open(destinationPath.c_str(), flags, st.st_mode & 07777);
+	if(destination < 0) {
+		close(source);
+		return false;
+	}
+
+	// Try the cheapest method first.  A clone shares the source's extents on
+	// file systems such as btrfs and XFS, so it takes constant time.  The
+	// in-kernel methods avoid copying through user space.  Each fallback
+	// continues from where the previous method stopped.
+	bool succeeded = true;
+	off_t offset = 0;
+	int result;
+	if(ioctl(destination, FICLONE, source) == 0) {
+		method = Clone;
+	} else if((result = CopyInKernel(source, destination, offset, progress)) != 0) {
+		method = InKernel;
+		succeeded = result > 0;
+	} else if((result = CopyWithSendFile(source, destination, offset, progress)) != 0) {
+		method = SendFile;
+		succeeded = result > 0;
+	} else {
+		method = Buffered;
+		succeeded = CopyBuffered(source, destination, offset, progress);
+	}
+
+	// Preserve the last write time as CopyFile does since the engine relies on
+	// the two files having the same time after a copy.
+	if(succeeded) {
+		struct timespec times[2] = { { 0, UTIME_OMIT }, st.st_mtim };
+		succeeded = futimens(destination, times) == 0;
+	}
+	close(source);
+	return close(destination) == 0 && succeeded;
+}
+
+bool FileSystem::LowerIoPriority() {
+	// With no process identifier, this applies to the calling thread.
+	return syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 0)) == 0;
+}
+
+bool FileSystem::Replace(tstring const& sourcePath, tstring const& destinationPath) {
+	return rename(sourcePath.c_str(), destinationPath.c_str()) == 0;
+}
+
+bool FileSystem::Delete(tstring const& filePath) {
+	return unlink(filePath.c_str()) == 0;
+}
+
+bool FileSystem::IsRotational(Device device) {
+	// A partition has no queue of its own so also try its disk's.
+	char const* const formats[] = { "/sys/dev/block/%u:%u/queue/rotational", "/sys/dev/block/%u:%u/../queue/rotational" };
+	for(auto format : formats) {
+		char path[64];
+		snprintf(path, sizeof(path), format, major(device), minor(device));
+		FILE* fin = fopen(path, "r");
+		if(fin != nullptr) {
+			int value = fgetc(fin);
+			fclose(fin);
+			return value == '1';
+		}
+	}
+	return false;
+}
+
+bool FileSystem::HasChangeNotifications(tstring const& folderPath) {
+	// These are the magic numbers of the network and FUSE file systems.
+	static unsigned long const types[] = {
+		0x6969, // NFS
+		0x517b, // SMB
+		0xff534d42, // CIFS
+		0xfe534d42, // SMB2
+		0x65735546, // FUSE
+		0x01021997, // 9P
+		0x00c36400, // Ceph
+		0x5346414f, // AFS
+		0x73757245, // Coda
+		0x47504653, // GPFS
+		0x0bd00bd0, // Lustre
+	};
+	struct statfs st;
+	if(statfs(folderPath.c_str(), &st) != 0) {
+		return true;
+	}
+	unsigned long type = static_cast<unsigned long>(st.f_type) & 0xffffffff;
+	return std::find(types, types + _countof(types), type) == types + _countof(types);
+}
+
+// The kernel refuses a read lease on a file open for writing.  Only the
+// owner of the file may take one.
+bool FileSystem::HasWriters(tstring const& filePath, bool& hasWriters) {
+	int fd = open(filePath.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if(fd < 0) {
+		return false;
+	}
+	bool isKnown = true;
+	hasWriters = false;
+	if(fcntl(fd, F_SETLEASE, F_RDLCK) == 0) {
+		fcntl(fd, F_SETLEASE, F_UNLCK);
+	} else if(errno == EAGAIN) {
+		hasWriters = true;
+	} else {
+		isKnown = false;
+	}
+	close(fd);
+	return isKnown;
+}
+
+bool FileSystem::CreateFolders(tstring const& folderPath) {
+	if(folderPath.empty()) {
+		return true;
+	}
+	struct stat st;
+	if(stat(folderPath.c_str(), &st) == 0) {
+		return S_ISDIR(st.st_mode);
+	}
+	tstring parentPath = GetFolder(folderPath);
+	if(parentPath != folderPath && !CreateFolders(parentPath)) {
+		return false;
+	}
+	return mkdir(folderPath.c_str(), 0777) == 0 || errno == EEXIST;
+}
+#endif
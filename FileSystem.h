@@ -0,0 +1,138 @@
+#pragma once
+
+// These functions hide the platform's file system interface from the
+// synchronization engine.
+namespace FileSystem
+{
+	// A file's last write time.  The unit and epoch are platform-dependent so
+	// compare these only with each other.
+	typedef unsigned long long Time;
+
+	// This identifies the device holding a file.
+	typedef unsigned long long Device;
+
+	struct Info
+	{
+		Time lastWriteTime;
+		unsigned long long size;
+		Device device;
+
+		// This identifies the file on its device, or is zero if unknown.
+		unsigned long long fileId;
+		bool isFolder;
+	};
+
+	// This is an open file with positional reads and writes.
+	class File
+	{
+	public:
+		enum Mode { ReadOnly, ReadWrite, Create };
+
+		// Unbuffered files bypass the system cache.  Their offsets, sizes,
+		// and buffer addresses must be multiples of this.
+		static size_t const UnbufferedAlignment = 4096;
+
+		File();
+		~File() { Close(); }
+		bool Open(tstring const& filePath, Mode mode);
+
+		// Open a file, without buffering if requested and the file system
+		// allows it.
+		bool Open(tstring const& filePath, Mode mode, bool unbuffered);
+		bool Close();
+		bool IsOpen() const;
+		bool IsUnbuffered() const { return isUnbuffered; }
+
+		// Read up to size bytes at offset.  Return the number read or -1.
+		long long Read(unsigned long long offset, void* buffer, size_t size);
+
+		// Write all of the bytes at offset.
+		bool Write(unsigned long long offset, void const* buffer, size_t size);
+
+		bool GetInfo(Info& info);
+		bool SetSize(unsigned long long size);
+		bool SetTime(Time lastWriteTime);
+
+	private:
+#ifdef _WIN32
+		HANDLE handle;
+#else
+		int fd;
+#endif
+		bool isUnbuffered;
+
+		File(File const&); // undefined
+		File& operator=(File const&); // undefined
+	};
+
+	// This describes an item of a folder.
+	struct Item
+	{
+		tstring name;
+		Info info;
+	};
+
+	bool GetInfo(tstring const& filePath, Info& info);
+
+	// List the files and folders of a folder, skipping links and other
+	// special items.
+	bool ListFolder(tstring const& folderPath, std::vector<Item>& items);
+
+	// Get the information of some files of a folder by name, as GetInfo
+	// would, without looking at the rest of the folder.  Get whether each
+	// was found.
+	void GetInfos(tstring const& folderPath, std::vector<tstring> const& names, std::vector<Info>& infos, std::vector<bool>& found);
+	bool GetTime(tstring const& filePath, Time& lastWriteTime);
+
+	// These are the ways Copy can copy a file, from cheapest to costliest.
+	// Native is the platform's own copy function.
+	enum CopyMethod { Native, Clone, InKernel, SendFile, Buffered, CopyMethodCount };
+
+	// A copy calls this, if set, after each chunk with the number of bytes in
+	// it.  The copy stops, leaving a partial destination, if it returns
+	// false.
+	typedef std::function<bool(unsigned long long)> Progress;
+
+	// Copy the contents and last write time of one file to another, like the
+	// Win32 CopyFile function.  Use the cheapest method the file system
+	// supports and report it.
+	bool Copy(tstring const& sourcePath, tstring const& destinationPath, bool failIfExists);
+	bool Copy(tstring const& sourcePath, tstring const& destinationPath, bool failIfExists, CopyMethod& method, Progress const& progress);
+
+	// Get a path in a form to compare with others.  Windows file names are
+	// not case-sensitive so compare them in lower case.
+	tstring GetKey(tstring const& path);
+
+	tstring GetFolder(tstring const& filePath);
+	tstring GetName(tstring const& filePath);
+	tstring Combine(tstring const& folderPath, tstring const& name);
+
+	// Determine whether a device is a spinning disk that suffers from
+	// concurrent access.
+	bool IsRotational(Device device);
+
+	// Determine whether the file system of a folder reliably reports changes
+	// to a watcher.  Network and FUSE file systems miss changes made
+	// elsewhere.
+	bool HasChangeNotifications(tstring const& folderPath);
+
+	// Determine whether another process has a file open for writing.
+	// Return false if the platform cannot tell.
+	bool HasWriters(tstring const& filePath, bool& hasWriters);
+
+	// Give the I/O of the calling thread the lowest priority so that of
+	// other processes goes first.
+	bool LowerIoPriority();
+
+	// Rename a file, replacing any file already at the new path.
+	bool Replace(tstring const& sourcePath, tstring const& destinationPath);
+	bool Delete(tstring const& filePath);
+
+	// Get the path of the temporary file beside a file that a full copy
+	// writes before replacing it.  Tree comparisons skip these files.
+	tstring GetTemporaryPath(tstring const& filePath);
+	bool IsTemporary(tstring const& name);
+
+	// Create a folder and any missing parents.
+	bool CreateFolders(tstring const& folderPath);
+};
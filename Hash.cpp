@@ -0,0 +1,141 @@
+#include "stdafx.h"
+#include "FileSystem.h"
+#include "Hash.h"
+#if defined(__SSE2__) || defined(_M_X64)
+#	include <emmintrin.h>
+#	define HASH_SSE2
+#endif
+
+static unsigned long long const prime1 = 0x9E3779B185EBCA87ull;
+static unsigned long long const prime2 = 0xC2B2AE3D27D4EB4Full;
+static unsigned long long const prime3 = 0x165667B19E3779F9ull;
+static unsigned int const prime32 = 0x9E3779B1u;
+
+// These are arbitrary odd constants mixed into the lanes.
+alignas(16) static unsigned long long const keys[8] = {
+	0xBE4BA423396CFEB8ull, 0x1CAD21F72C81017Cull, 0xDB979083E96DD4DEull, 0x1F67B3B7A4A44072ull,
+	0x78E5C0CC4EE679CBull, 0x2172FFCC7DD05A82ull, 0x8E2443F7744608B8ull, 0x4C263A81E69035E0ull,
+};
+
+static unsigned long long Avalanche(unsigned long long value) {
+	value ^= value >> 37;
+	value *= prime3;
+	value ^= value >> 32;
+	return value;
+}
+
+Hash::Hash() : bufferSize(), stripeCount(), totalSize() {
+	for(int i = 0; i < laneCount; ++i) {
+		accumulators[i] = keys[i] ^ prime1 * (i + 1);
+	}
+}
+
+#ifndef HASH_SSE2
+static unsigned long long Load64(unsigned char const* p) {
+	unsigned long long value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+#endif
+
+// Mix one stripe into the lanes.  Each lane adds the product of the low and
+// high halves of its keyed input and also the raw input of its neighbor.
+void Hash::Accumulate(unsigned char const* stripe) {
+#ifdef HASH_SSE2
+	for(int i = 0; i < laneCount; i += 2) {
+		__m128i accumulator = _mm_loadu_si128(reinterpret_cast<__m128i const*>(accumulators + i));
+		__m128i data = _mm_loadu_si128(reinterpret_cast<__m128i const*>(stripe + i * 8));
+		__m128i keyed = _mm_xor_si128(data, _mm_load_si128(reinterpret_cast<__m128i const*>(keys + i)));
+		__m128i product = _mm_mul_epu32(keyed, _mm_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+		__m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+		accumulator = _mm_add_epi64(accumulator, _mm_add_epi64(product, swapped));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(accumulators + i), accumulator);
+	}
+#else
+	for(int i = 0; i < laneCount; ++i) {
+		unsigned long long data = Load64(stripe + i * 8);
+		unsigned long long keyed = data ^ keys[i];
+		accumulators[i] += (keyed & 0xFFFFFFFF) * (keyed >> 32);
+		accumulators[i ^ 1] += data;
+	}
+#endif
+	if(++stripeCount % stripesPerBlock == 0) {
+		Scramble();
+	}
+}
+
+// Fold the high bits of each lane down so they affect later products.
+void Hash::Scramble() {
+	for(int i = 0; i < laneCount; ++i) {
+		unsigned long long value = accumulators[i];
+		value ^= value >> 47;
+		value ^= keys[laneCount - 1 - i];
+		accumulators[i] = value * prime32;
+	}
+}
+
+void Hash::Update(void const* data, size_t size) {
+	unsigned char const* p = static_cast<unsigned char const*>(data);
+	totalSize += size;
+	if(bufferSize > 0) {
+		size_t n = std::min(size, stripeSize - bufferSize);
+		memcpy(buffer + bufferSize, p, n);
+		bufferSize += n;
+		p += n;
+		size -= n;
+		if(bufferSize < stripeSize) {
+			return;
+		}
+		Accumulate(buffer);
+		bufferSize = 0;
+	}
+	for(; size >= stripeSize; p += stripeSize, size -= stripeSize) {
+		Accumulate(p);
+	}
+	memcpy(buffer, p, size);
+	bufferSize = size;
+}
+
+unsigned long long Hash::Finish() const {
+	// Pad the last partial stripe with zeros; the total size distinguishes
+	// it from data that ends in zeros.
+	Hash copy(*this);
+	if(copy.bufferSize > 0) {
+		memset(copy.buffer + copy.bufferSize, 0, stripeSize - copy.bufferSize);
+		copy.Accumulate(copy.buffer);
+	}
+	unsigned long long result = totalSize * prime1;
+	for(int i = 0; i < laneCount; i += 2) {
+		unsigned long long a = copy.accumulators[i] ^ keys[i], b = copy.accumulators[i + 1] ^ keys[i + 1];
+		result += Avalanche(a * prime2 + (b ^ (b >> 29)));
+		result = (result << 27 | result >> 37) * prime1;
+	}
+	return Avalanche(result);
+}
+
+unsigned long long Hash::Compute(void const* data, size_t size) {
+	Hash hash;
+	hash.Update(data, size);
+	return hash.Finish();
+}
+
+bool Hash::ComputeFile(tstring const& filePath, unsigned long long& hash, FileSystem::Info* info) {
+	FileSystem::File file;
+	if(!file.Open(filePath, FileSystem::File::ReadOnly) || (info != nullptr && !file.GetInfo(*info))) {
+		return false;
+	}
+	std::vector<unsigned char> buffer(1 << 20);
+	Hash value;
+	for(unsigned long long offset = 0;;) {
+		long long n = file.Read(offset, &buffer[0], buffer.size());
+		if(n < 0) {
+			return false;
+		} else if(n == 0) {
+			break;
+		}
+		value.Update(&buffer[0], static_cast<size_t>(n));
+		offset += n;
+	}
+	hash = value.Finish();
+	return true;
+}
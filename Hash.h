@@ -0,0 +1,31 @@
+#pragma once
+
+#include "FileSystem.h"
+
+// This is a fast non-cryptographic 64-bit hash for comparing file contents.
+// It keeps eight 64-bit lanes that each take a 32x32-bit multiply per eight
+// bytes, so SSE2 processes two lanes per instruction.
+class Hash
+{
+public:
+	Hash();
+	void Update(void const* data, size_t size);
+	unsigned long long Finish() const;
+
+	static unsigned long long Compute(void const* data, size_t size);
+
+	// Hash a file's contents.  Optionally get its information from the same
+	// open file.
+	static bool ComputeFile(tstring const& filePath, unsigned long long& hash, FileSystem::Info* info);
+
+private:
+	enum { laneCount = 8, stripeSize = laneCount * 8, stripesPerBlock = 16 };
+
+	unsigned long long accumulators[laneCount];
+	unsigned char buffer[stripeSize];
+	size_t bufferSize, stripeCount;
+	unsigned long long totalSize;
+
+	void Accumulate(unsigned char const* stripe);
+	void Scramble();
+};
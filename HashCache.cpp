@@ -0,0 +1,148 @@
+#include "stdafx.h"
+#include "Hash.h"
+#include "HashCache.h"
+
+// The file is this signature followed by records of a Record structure, a
+// path length in characters, and the path.
+static char const signature[8] = { 'F', 'S', 'H', 'C', 1, 0, 0, sizeof(TCHAR) };
+
+// No path is longer than this many characters.
+static unsigned int const maximumPathLength = 32767;
+
+bool HashCache::Matches(Record const& record, FileSystem::Info const& info) {
+	return record.size == info.size && record.lastWriteTime == info.lastWriteTime && record.fileId == info.fileId;
+}
+
+bool HashCache::GetHash(tstring const& filePath, FileSystem::Info const& info, unsigned long long& hash, bool& computed) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = records.find(filePath);
+		if(it != records.end() && Matches(it->second, info)) {
+			hash = it->second.hash;
+			computed = false;
+			return true;
+		}
+	}
+
+	// Hash without the lock so other files need not wait.  Use the
+	// information of the open file so a change after the caller's look
+	// is not stored under the old information.
+	FileSystem::Info actualInfo;
+	if(!Hash::ComputeFile(filePath, hash, &actualInfo)) {
+		return false;
+	}
+	computed = true;
+	if(info.fileId == 0) {
+		// The caller's information has no file identifier.
+		actualInfo.fileId = 0;
+	}
+	SetHash(filePath, actualInfo, hash);
+	return Matches(Record{ actualInfo.size, actualInfo.lastWriteTime, actualInfo.fileId, hash }, info);
+}
+
+void HashCache::SetHash(tstring const& filePath, FileSystem::Info const& info, unsigned long long hash) {
+	Record record = { info.size, info.lastWriteTime, info.fileId, hash };
+	std::lock_guard<std::mutex> lock(mutex);
+	records[filePath] = record;
+	isDirty = true;
+}
+
+bool HashCache::Load(tstring const& path) {
+	std::ifstream fin(path.c_str(), std::ios::binary | std::ios::ate);
+	if(!fin) {
+		return false;
+	}
+	unsigned long long fileSize = static_cast<unsigned long long>(fin.tellg());
+	fin.seekg(0);
+	char fileSignature[sizeof(signature)];
+	if(!fin.read(fileSignature, sizeof(fileSignature)) || memcmp(fileSignature, signature, sizeof(signature)) != 0) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	Record record;
+	unsigned int length;
+	tstring filePath;
+	while(fin.read(reinterpret_cast<char*>(&record), sizeof(record)) && fin.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+		// A damaged file might claim any length.
+		unsigned long long offset = static_cast<unsigned long long>(fin.tellg());
+		if(length > maximumPathLength || length * sizeof(TCHAR) > fileSize - offset) {
+			break;
+		}
+		filePath.resize(length);
+		if(length > 0 && !fin.read(reinterpret_cast<char*>(&filePath[0]), length * sizeof(TCHAR))) {
+			break;
+		}
+		records[filePath] = record;
+	}
+	return true;
+}
+
+// Write the cache to a new file and replace the old one with it so a crash
+// does not leave a partial cache.  Work on a copy of the records so lookups
+// need not wait for the file system.
+bool HashCache::Save(tstring const& path) {
+	std::unique_lock<std::mutex> saveLock(saveMutex, std::try_to_lock);
+	if(!saveLock.owns_lock()) {
+		return true;
+	}
+	std::unordered_map<tstring, Record> savedRecords;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		savedRecords = records;
+	}
+
+	// Forget the records of files that are gone or changed.  Keep those
+	// remembered again meanwhile.
+	std::vector<std::pair<tstring, Record>> staleRecords;
+	for(auto it = savedRecords.begin(); it != savedRecords.end();) {
+		FileSystem::Info info;
+		bool isCurrent = FileSystem::GetInfo(it->first, info);
+		if(isCurrent && (info.fileId == 0 || it->second.fileId == 0)) {
+			// Compare the file identifiers only if both are known.
+			info.fileId = it->second.fileId;
+		}
+		if(!isCurrent || !Matches(it->second, info)) {
+			staleRecords.push_back(*it);
+			it = savedRecords.erase(it);
+		} else {
+			++it;
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for(auto const& pair : staleRecords) {
+			auto it = records.find(pair.first);
+			if(it != records.end() && memcmp(&it->second, &pair.second, sizeof(Record)) == 0) {
+				records.erase(it);
+				isDirty = true;
+			}
+		}
+		if(!isDirty) {
+			return true;
+		}
+		isDirty = false;
+	}
+	tstring temporaryPath = path + _T(".new");
+	bool succeeded = WriteRecords(temporaryPath, savedRecords) && FileSystem::Replace(temporaryPath, path);
+	if(!succeeded) {
+		std::lock_guard<std::mutex> lock(mutex);
+		isDirty = true;
+	}
+	return succeeded;
+}
+
+// Write a cache file.
+bool HashCache::WriteRecords(tstring const& path, std::unordered_map<tstring, Record> const& records) {
+	std::ofstream fout(path.c_str(), std::ios::binary | std::ios::trunc);
+	if(!fout.write(signature, sizeof(signature))) {
+		return false;
+	}
+	for(auto const& pair : records) {
+		unsigned int length = static_cast<unsigned int>(pair.first.size());
+		fout.write(reinterpret_cast<char const*>(&pair.second), sizeof(pair.second));
+		fout.write(reinterpret_cast<char const*>(&length), sizeof(length));
+		fout.write(reinterpret_cast<char const*>(pair.first.data()), length * sizeof(TCHAR));
+	}
+	fout.close();
+	return !fout.fail();
+}
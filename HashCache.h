@@ -0,0 +1,41 @@
+#pragma once
+
+#include "FileSystem.h"
+
+// A hash cache remembers the content hashes of files so an unchanged file
+// is never hashed twice.  A hash is valid while the file's size, last write
+// time and file identifier match those it was computed for.
+class HashCache
+{
+public:
+	HashCache() : isDirty(false) {}
+
+	// Look up a file's hash, computing and remembering it if necessary.
+	// Other threads may call this concurrently.
+	bool GetHash(tstring const& filePath, FileSystem::Info const& info, unsigned long long& hash, bool& computed);
+
+	// Remember a hash known by other means, such as after a copy.
+	void SetHash(tstring const& filePath, FileSystem::Info const& info, unsigned long long hash);
+
+	// Load a cache file up to its first damaged record.
+	bool Load(tstring const& path);
+
+	// Forget the hashes of files that are gone or changed and write the
+	// cache if it changed.  Other threads may look up and remember hashes
+	// meanwhile.  A save already in progress on another thread makes this
+	// do nothing.
+	bool Save(tstring const& path);
+
+private:
+	struct Record
+	{
+		unsigned long long size, lastWriteTime, fileId, hash;
+	};
+
+	std::mutex mutex, saveMutex;
+	std::unordered_map<tstring, Record> records;
+	bool isDirty;
+
+	static bool Matches(Record const& record, FileSystem::Info const& info);
+	static bool WriteRecords(tstring const& path, std::unordered_map<tstring, Record> const& records);
+};
@@ -0,0 +1,57 @@
+#include "stdafx.h"
+#include "Histogram.h"
+
+Histogram::Histogram() : count(), sum(), maximum() {
+	for(auto& bucket : counts) {
+		bucket = 0;
+	}
+}
+
+void Histogram::Record(unsigned long long value) {
+	counts[GetIndex(value)].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(value, std::memory_order_relaxed);
+	unsigned long long previous = maximum.load(std::memory_order_relaxed);
+	while(value > previous && !maximum.compare_exchange_weak(previous, value, std::memory_order_relaxed)) {
+	}
+}
+
+unsigned long long Histogram::GetPercentile(double fraction) const {
+	unsigned long long total = get_Count();
+	if(total == 0) {
+		return 0;
+	}
+	unsigned long long target = static_cast<unsigned long long>(fraction * total + 0.5);
+	target = std::max(1ull, std::min(target, total));
+	unsigned long long seen = 0;
+	for(unsigned i = 0; i < bucketCount; ++i) {
+		seen += counts[i].load(std::memory_order_relaxed);
+		if(seen >= target) {
+			return std::min(GetHighestValue(i), get_Maximum());
+		}
+	}
+	return get_Maximum();
+}
+
+// A value at or above 16 has a magnitude, the position of its highest bit.
+// Its bucket is the next subBucketBits bits in the row for its magnitude.
+unsigned Histogram::GetIndex(unsigned long long value) {
+	if(value < subBucketCount) {
+		return static_cast<unsigned>(value);
+	}
+	unsigned magnitude = 0;
+	for(unsigned long long v = value; v >>= 1;) {
+		++magnitude;
+	}
+	unsigned shift = magnitude - subBucketBits;
+	return (shift + 1) * subBucketCount + static_cast<unsigned>((value >> shift) - subBucketCount);
+}
+
+unsigned long long Histogram::GetHighestValue(unsigned index) {
+	if(index < subBucketCount) {
+		return index;
+	}
+	unsigned shift = index / subBucketCount - 1;
+	unsigned long long lowest = static_cast<unsigned long long>(subBucketCount + index % subBucketCount) << shift;
+	return lowest + ((1ull << shift) - 1);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+// A histogram counts values, such as latencies in microseconds, in buckets
+// whose width grows with the value, like an HDR histogram.  It keeps about
+// six percent precision from one to the largest value.  Threads record
+// values without locks.
+class Histogram
+{
+public:
+	Histogram();
+	void Record(unsigned long long value);
+
+	unsigned long long get_Count() const { return count.load(std::memory_order_relaxed); }
+	unsigned long long get_Sum() const { return sum.load(std::memory_order_relaxed); }
+	unsigned long long get_Maximum() const { return maximum.load(std::memory_order_relaxed); }
+
+	// Get the value at or below which the given fraction of the values fall,
+	// within the precision of the buckets.  Values recorded meanwhile might
+	// or might not count.
+	unsigned long long GetPercentile(double fraction) const;
+
+private:
+	// Each power of two from 16 up has subBucketCount buckets; the values
+	// below 16 have a bucket each.
+	enum { subBucketBits = 4, subBucketCount = 1 << subBucketBits, bucketCount = (64 - subBucketBits + 1) * subBucketCount };
+
+	std::atomic<unsigned long long> counts[bucketCount];
+	std::atomic<unsigned long long> count, sum, maximum;
+
+	static unsigned GetIndex(unsigned long long value);
+	static unsigned long long GetHighestValue(unsigned index);
+
+	Histogram(Histogram const&); // undefined
+	Histogram& operator=(Histogram const&); // undefined
+};
@@ -0,0 +1,248 @@
+#include "stdafx.h"
+#include "EventQueue.h"
+#include "Watcher.h"
+
+namespace {
+	// One inotify instance multiplexes all watched folders so the cost of
+	// an event does not depend on the number of folders.  A reader thread
+	// drains the inotify queue into a bounded event queue as soon as events
+	// arrive, so the kernel rarely drops events while the engine is busy.
+	// When the event queue is full, the reader keeps draining and remembers
+	// the folders whose events it dropped; each then gets one overflow event
+	// so only those folders are compared again.
+	class InotifyWatcher : public Watcher
+	{
+	public:
+		InotifyWatcher();
+		~InotifyWatcher();
+		void SetFolders(std::set<tstring> const& folderPaths) override;
+		Result Wait(std::vector<Event>& events, int timeout) override;
+		void Wake() override;
+		size_t get_FolderCount() const override;
+
+	private:
+		int fd, signal, ready, stop;
+		std::thread reader;
+		EventQueue queue;
+
+		// The mutex serializes reads of the inotify queue, so events keep
+		// their order, and protects these.  An empty path among the
+		// overflowed folders stands for all folders.
+		mutable std::mutex mutex;
+		std::unordered_map<int, tstring> folderPaths;
+		std::unordered_map<tstring, int> watchDescriptors;
+		std::set<tstring> overflowedFolderPaths;
+
+		void Read();
+		bool ReadEvents();
+		void Push(Event&& event);
+	};
+}
+
+static uint32_t const mask = IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MODIFY | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+
+InotifyWatcher::InotifyWatcher() : fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)), signal(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+	ready(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), stop(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), queue(16384) {
+	if(fd >= 0 && signal >= 0 && ready >= 0 && stop >= 0) {
+		reader = std::thread(&InotifyWatcher::Read, this);
+	}
+}
+
+InotifyWatcher::~InotifyWatcher() {
+	if(reader.joinable()) {
+		uint64_t value = 1;
+		VERIFY(write(stop, &value, sizeof(value)) == sizeof(value));
+		reader.join();
+	}
+	for(int descriptor : { fd, signal, ready, stop }) {
+		if(descriptor >= 0) {
+			close(descriptor);
+		}
+	}
+}
+
+size_t InotifyWatcher::get_FolderCount() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return folderPaths.size();
+}
+
+void InotifyWatcher::SetFolders(std::set<tstring> const& folderPaths) {
+	std::lock_guard<std::mutex> lock(mutex);
+	// Remove the watches of folders not in the new set.
+	for(auto it = watchDescriptors.begin(); it != watchDescriptors.end();) {
+		if(folderPaths.find(it->first) == folderPaths.end()) {
+			inotify_rm_watch(fd, it->second);
+			this->folderPaths.erase(it->second);
+			it = watchDescriptors.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	// Add watches for folders not in the old set.  Retry folders that failed
+	// before since they might exist now.
+	for(auto const& folderPath : folderPaths) {
+		if(watchDescriptors.find(folderPath) == watchDescriptors.end()) {
+			int wd = inotify_add_watch(fd, folderPath.c_str(), mask);
+			if(wd >= 0) {
+				this->folderPaths[wd] = folderPath;
+				watchDescriptors[folderPath] = wd;
+			}
+		}
+	}
+}
+
+Watcher::Result InotifyWatcher::Wait(std::vector<Event>& events, int timeout) {
+	if(!reader.joinable()) {
+		return Failed;
+	}
+	for(;;) {
+		// Take the events the reader queued, then read the rest of the inotify
+		// queue so the events of all changes made before this call return.
+		Event event;
+		while(queue.TryPop(event)) {
+			events.push_back(std::move(event));
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if(!ReadEvents()) {
+				return Failed;
+			}
+		}
+		while(queue.TryPop(event)) {
+			events.push_back(std::move(event));
+		}
+		if(!events.empty()) {
+			return Changed;
+		}
+
+		pollfd fds[] = { { signal, POLLIN, 0 }, { ready, POLLIN, 0 } };
+		int n = poll(fds, _countof(fds), timeout);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return Failed;
+		} else if(n == 0) {
+			return TimedOut;
+		}
+		uint64_t value;
+		if(fds[0].revents & POLLIN) {
+			VERIFY(read(signal, &value, sizeof(value)) == sizeof(value));
+			return Woken;
+		}
+		if(fds[1].revents & POLLIN) {
+			VERIFY(read(ready, &value, sizeof(value)) == sizeof(value));
+		}
+	}
+}
+
+// Drain the inotify queue whenever it has events until the destructor
+// signals.
+void InotifyWatcher::Read() {
+	for(;;) {
+		pollfd fds[] = { { stop, POLLIN, 0 }, { fd, POLLIN, 0 } };
+		if(poll(fds, _countof(fds), -1) < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return;
+		}
+		if(fds[0].revents & POLLIN) {
+			return;
+		}
+		if(fds[1].revents & POLLIN) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if(!ReadEvents()) {
+					return;
+				}
+			}
+			uint64_t value = 1;
+			VERIFY(write(ready, &value, sizeof(value)) == sizeof(value));
+		}
+	}
+}
+
+void InotifyWatcher::Wake() {
+	uint64_t value = 1;
+	VERIFY(write(signal, &value, sizeof(value)) == sizeof(value));
+}
+
+static bool TranslateMask(uint32_t mask, Watcher::Action& action) {
+	if(mask & IN_Q_OVERFLOW) {
+		action = Watcher::Overflow;
+	} else if(mask & IN_CREATE) {
+		action = Watcher::Added;
+	} else if(mask & IN_DELETE) {
+		action = Watcher::Removed;
+	} else if(mask & IN_MOVED_FROM) {
+		action = Watcher::RenamedFrom;
+	} else if(mask & IN_MOVED_TO) {
+		action = Watcher::RenamedTo;
+	} else if(mask & (IN_ATTRIB | IN_CLOSE_WRITE | IN_MODIFY)) {
+		action = Watcher::Modified;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// Queue an event, or remember to compare its folder again if the queue is
+// full.  Call this with the mutex held.
+void InotifyWatcher::Push(Event&& event) {
+	if(!overflowedFolderPaths.empty() && (overflowedFolderPaths.count(tstring()) || overflowedFolderPaths.count(event.folderPath))) {
+		// An overflow event will cover this one.
+		return;
+	}
+	if(!queue.TryPush(std::move(event))) {
+		overflowedFolderPaths.insert(event.folderPath);
+	}
+}
+
+// Queue the overflow events the full queue held back and drain the inotify
+// queue, translating its events.  Call this with the mutex held.
+bool InotifyWatcher::ReadEvents() {
+	for(auto it = overflowedFolderPaths.begin(); it != overflowedFolderPaths.end(); it = overflowedFolderPaths.erase(it)) {
+		if(!queue.TryPush(Event{ *it, tstring(), Overflow })) {
+			break;
+		}
+	}
+	alignas(inotify_event) char buffer[16384];
+	for(;;) {
+		ssize_t n = read(fd, buffer, sizeof(buffer));
+		if(n < 0) {
+			return errno == EAGAIN || errno == EINTR;
+		}
+		for(char* p = buffer; p < buffer + n;) {
+			inotify_event const* event = reinterpret_cast<inotify_event const*>(p);
+			p += sizeof(inotify_event) + event->len;
+			if(event->mask & IN_IGNORED) {
+				// The folder went away or was removed in SetFolders.
+				auto it = folderPaths.find(event->wd);
+				if(it != folderPaths.end()) {
+					watchDescriptors.erase(it->second);
+					folderPaths.erase(it);
+				}
+				continue;
+			}
+			Action action;
+			if(!TranslateMask(event->mask, action)) {
+				continue;
+			}
+			if(action == Overflow) {
+				// The kernel does not say whose events it dropped.
+				Push(Event{ tstring(), tstring(), action });
+				continue;
+			}
+			auto it = folderPaths.find(event->wd);
+			if(it != folderPaths.end() && event->len > 0) {
+				Push(Event{ it->second, event->name, action });
+			}
+		}
+	}
+}
+
+std::unique_ptr<Watcher> Watcher::Create() {
+	return std::unique_ptr<Watcher>(new InotifyWatcher);
+}
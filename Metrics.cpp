@@ -0,0 +1,95 @@
+#include "stdafx.h"
+#include "FileSystem.h"
+#include "Metrics.h"
+
+// These are the percentiles a snapshot reports for each latency.
+static struct
+{
+	char const* name;
+	double fraction;
+} const percentiles[] = { { "p50", 0.5 }, { "p90", 0.9 }, { "p99", 0.99 }, { "p999", 0.999 } };
+
+Metrics::Metrics() {
+	for(auto& counter : counters) {
+		counter = 0;
+	}
+}
+
+void Metrics::Record(Latency latency, std::chrono::steady_clock::duration duration) {
+	long long microseconds = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+	histograms[latency].Record(microseconds > 0 ? microseconds : 0);
+}
+
+static void Append(std::string& s, char const* format, ...) {
+	char buffer[256];
+	va_list arguments;
+	va_start(arguments, format);
+	int n = vsnprintf(buffer, sizeof(buffer), format, arguments);
+	va_end(arguments);
+	if(n > 0) {
+		s.append(buffer, std::min<size_t>(n, sizeof(buffer) - 1));
+	}
+}
+
+std::string Metrics::FormatText() const {
+	std::string s;
+	for(int i = 0; i < CounterCount; ++i) {
+		Append(s, "%s%s %llu", i == 0 ? "" : ", ", GetCounterName(static_cast<Counter>(i)), get_Counter(static_cast<Counter>(i)));
+	}
+	s += '\n';
+	for(int i = 0; i < LatencyCount; ++i) {
+		Histogram const& histogram = histograms[i];
+		Append(s, "%s microseconds: count %llu", GetLatencyName(static_cast<Latency>(i)), histogram.get_Count());
+		for(auto const& percentile : percentiles) {
+			Append(s, ", %s %llu", percentile.name, histogram.GetPercentile(percentile.fraction));
+		}
+		Append(s, ", max %llu\n", histogram.get_Maximum());
+	}
+	return s;
+}
+
+std::string Metrics::FormatJson() const {
+	std::string s = "{\"counters\":{";
+	for(int i = 0; i < CounterCount; ++i) {
+		Append(s, "%s\"%s\":%llu", i == 0 ? "" : ",", GetCounterName(static_cast<Counter>(i)), get_Counter(static_cast<Counter>(i)));
+	}
+	s += "},\"latencies_us\":{";
+	for(int i = 0; i < LatencyCount; ++i) {
+		Histogram const& histogram = histograms[i];
+		Append(s, "%s\"%s\":{\"count\":%llu,\"sum\":%llu", i == 0 ? "" : ",", GetLatencyName(static_cast<Latency>(i)), histogram.get_Count(),
+			histogram.get_Sum());
+		for(auto const& percentile : percentiles) {
+			Append(s, ",\"%s\":%llu", percentile.name, histogram.GetPercentile(percentile.fraction));
+		}
+		Append(s, ",\"max\":%llu}", histogram.get_Maximum());
+	}
+	s += "}}\n";
+	return s;
+}
+
+bool Metrics::WriteSnapshot(tstring const& path) const {
+	std::string json = FormatJson();
+	tstring temporaryPath = path + _T(".new");
+	{
+		std::ofstream fout(temporaryPath.c_str(), std::ios::binary | std::ios::trunc);
+		fout.write(json.data(), json.size());
+		fout.close();
+		if(fout.fail()) {
+			return false;
+		}
+	}
+	return FileSystem::Replace(temporaryPath, path);
+}
+
+char const* Metrics::GetCounterName(Counter counter) {
+	static char const* const names[] = { "wakeups", "events", "entries_scanned", "synchronizations", "copies", "copy_failures", "bytes_copied",
+		"polls", "echoes", "deferrals", "cancellations", "throttled_us" };
+	static_assert(_countof(names) == CounterCount, "missing counter name");
+	return names[counter];
+}
+
+char const* Metrics::GetLatencyName(Latency latency) {
+	static char const* const names[] = { "change_to_copy", "synchronization", "copy" };
+	static_assert(_countof(names) == LatencyCount, "missing latency name");
+	return names[latency];
+}
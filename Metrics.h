@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Histogram.h"
+
+// Metrics are the counters and latency histograms of the engine.  Any
+// thread updates them without locks.  A snapshot formats them as text for
+// people or as JSON for monitoring.
+class Metrics
+{
+public:
+	// Wakeups counts the returns from the watcher, Events the changes it
+	// reported, and EntriesScanned the entries those changes matched.
+	// BytesCopied counts the sizes of the files copied, Polls the listings
+	// of folders whose file systems do not report changes, Echoes the events
+	// of the engine's own writes, Deferrals the copies of files still being
+	// written, Cancellations the copies a newer change stopped, and
+	// ThrottledTime the microseconds copies waited for their rate limits.
+	enum Counter { Wakeups, Events, EntriesScanned, Synchronizations, Copies, CopyFailures, BytesCopied, Polls, Echoes, Deferrals, Cancellations,
+		ThrottledTime, CounterCount };
+
+	// ChangeToCopy is the time from the first change of an entry to the end
+	// of the synchronization that copied it.  Latencies are in microseconds.
+	enum Latency { ChangeToCopy, Synchronization, Copy, LatencyCount };
+
+	Metrics();
+	void Add(Counter counter, unsigned long long value) { counters[counter].fetch_add(value, std::memory_order_relaxed); }
+	void Increment(Counter counter) { Add(counter, 1); }
+	void Record(Latency latency, std::chrono::steady_clock::duration duration);
+
+	unsigned long long get_Counter(Counter counter) const { return counters[counter].load(std::memory_order_relaxed); }
+	Histogram const& get_Histogram(Latency latency) const { return histograms[latency]; }
+
+	std::string FormatText() const;
+	std::string FormatJson() const;
+
+	// Write the JSON snapshot to a new file and replace the old one with it
+	// so a reader never sees a partial snapshot.
+	bool WriteSnapshot(tstring const& path) const;
+
+	static char const* GetCounterName(Counter counter);
+	static char const* GetLatencyName(Latency latency);
+
+private:
+	std::atomic<unsigned long long> counters[CounterCount];
+	Histogram histograms[LatencyCount];
+
+	Metrics(Metrics const&); // undefined
+	Metrics& operator=(Metrics const&); // undefined
+};
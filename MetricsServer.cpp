@@ -0,0 +1,77 @@
+#include "stdafx.h"
+#include "MetricsServer.h"
+
+MetricsServer::MetricsServer(Metrics const& metrics) : metrics(metrics), listener(-1), signal(-1) {}
+
+MetricsServer::~MetricsServer() {
+	Stop();
+}
+
+bool MetricsServer::Start(tstring const& socketPath) {
+	ASSERT(!thread.joinable());
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if(socketPath.size() >= sizeof(address.sun_path)) {
+		return false;
+	}
+	memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+	listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	signal = eventfd(0, EFD_CLOEXEC);
+	if(listener < 0 || signal < 0) {
+		Stop();
+		return false;
+	}
+	unlink(socketPath.c_str());
+	if(bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 4) != 0) {
+		Stop();
+		return false;
+	}
+	this->socketPath = socketPath;
+	thread = std::thread(&MetricsServer::Run, this);
+	return true;
+}
+
+void MetricsServer::Stop() {
+	if(thread.joinable()) {
+		uint64_t value = 1;
+		VERIFY(write(signal, &value, sizeof(value)) == sizeof(value));
+		thread.join();
+	}
+	if(listener >= 0) {
+		close(listener);
+		listener = -1;
+	}
+	if(signal >= 0) {
+		close(signal);
+		signal = -1;
+	}
+	if(!socketPath.empty()) {
+		unlink(socketPath.c_str());
+		socketPath.clear();
+	}
+}
+
+// Serve until Stop signals.  A snapshot fits in the socket's buffer, so
+// sending without waiting does not let a slow client hold up the others.
+void MetricsServer::Run() {
+	for(;;) {
+		pollfd fds[] = { { signal, POLLIN, 0 }, { listener, POLLIN, 0 } };
+		if(poll(fds, _countof(fds), -1) < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return;
+		}
+		if(fds[0].revents & POLLIN) {
+			return;
+		}
+		if(fds[1].revents & POLLIN) {
+			int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+			if(client >= 0) {
+				std::string snapshot = metrics.FormatJson();
+				send(client, snapshot.data(), snapshot.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+				close(client);
+			}
+		}
+	}
+}
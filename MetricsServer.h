@@ -0,0 +1,28 @@
+#pragma once
+
+#include "Metrics.h"
+
+// A metrics server answers each connection to a local socket with a JSON
+// snapshot of the metrics and closes it, so a monitoring scraper can read
+// them with any client of Unix sockets.
+class MetricsServer
+{
+public:
+	explicit MetricsServer(Metrics const& metrics);
+	~MetricsServer();
+
+	// Listen on the socket, replacing a stale one at the path.
+	bool Start(tstring const& socketPath);
+	void Stop();
+
+private:
+	Metrics const& metrics;
+	tstring socketPath;
+	int listener, signal;
+	std::thread thread;
+
+	void Run();
+
+	MetricsServer(MetricsServer const&); // undefined
+	MetricsServer& operator=(MetricsServer const&); // undefined
+};
@@ -0,0 +1,52 @@
+#include "stdafx.h"
+#include "FileSystem.h"
+#include "PathArena.h"
+
+PathArena::Span PathArena::Append(tstring const& text) {
+	Span span = { static_cast<unsigned>(characters.size()), static_cast<unsigned>(text.size()) };
+	characters.insert(characters.end(), text.begin(), text.end());
+	return span;
+}
+
+PathArena::Path PathArena::Add(tstring const& path) {
+	tstring folderPath = FileSystem::GetFolder(path);
+	auto it = folderIds.find(folderPath);
+	unsigned folder;
+	if(it == folderIds.end()) {
+		folder = static_cast<unsigned>(folders.size());
+		folders.push_back(Append(folderPath));
+		folderIds.insert(std::make_pair(folderPath, folder));
+	} else {
+		folder = it->second;
+	}
+	Span name = Append(FileSystem::GetName(path));
+	Path result = { folder, name.offset, name.length };
+	return result;
+}
+
+tstring PathArena::Get(Path const& path) const {
+	TCHAR const* name = characters.data() + path.nameOffset;
+	return FileSystem::Combine(GetFolder(path), tstring(name, name + path.nameLength));
+}
+
+tstring PathArena::GetFolder(Path const& path) const {
+	Span const& folder = folders[path.folder];
+	TCHAR const* p = characters.data() + folder.offset;
+	return tstring(p, p + folder.length);
+}
+
+void PathArena::Clear() {
+	characters.clear();
+	folders.clear();
+	folderIds.clear();
+}
+
+void PathArena::Seal() {
+	characters.shrink_to_fit();
+	folders.shrink_to_fit();
+	std::unordered_map<tstring, unsigned>().swap(folderIds);
+}
+
+size_t PathArena::get_Size() const {
+	return characters.capacity() * sizeof(TCHAR) + folders.capacity() * sizeof(Span);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+// A path arena holds many paths in one block of characters.  It splits each
+// path into its folder and name and stores each distinct folder once, so the
+// paths of entries sharing folders cost little more than their names.
+class PathArena
+{
+public:
+	struct Path
+	{
+		unsigned folder, nameOffset, nameLength;
+	};
+
+	Path Add(tstring const& path);
+	tstring Get(Path const& path) const;
+	tstring GetFolder(Path const& path) const;
+	void Clear();
+
+	// Release the memory used only for adding paths.
+	void Seal();
+
+	// Get the number of bytes the arena uses.
+	size_t get_Size() const;
+
+private:
+	struct Span
+	{
+		unsigned offset, length;
+	};
+
+	std::vector<TCHAR> characters;
+	std::vector<Span> folders;
+	std::unordered_map<tstring, unsigned> folderIds;
+
+	Span Append(tstring const& text);
+};
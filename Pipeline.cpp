@@ -0,0 +1,166 @@
+#include "stdafx.h"
+#include "Pipeline.h"
+
+long long const Pipeline::Empty;
+
+static size_t const alignment = FileSystem::File::UnbufferedAlignment;
+
+static size_t Align(size_t size) {
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+static char* AllocateAligned(size_t size) {
+#ifdef _WIN32
+	return static_cast<char*>(_aligned_malloc(size, alignment));
+#else
+	void* p;
+	return posix_memalign(&p, alignment, size) == 0 ? static_cast<char*>(p) : nullptr;
+#endif
+}
+
+static void FreeAligned(char* p) {
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+Pipeline::Pipeline(size_t bufferSize, unsigned depth) : bufferSize(Align(std::max<size_t>(bufferSize, 1))), writerCount(0), failed(false) {
+	buffers.resize(std::max(depth, 2u));
+	for(auto& buffer : buffers) {
+		buffer = AllocateAligned(this->bufferSize);
+		if(buffer == nullptr) {
+			throw std::bad_alloc();
+		}
+	}
+}
+
+Pipeline::~Pipeline() {
+	for(char* buffer : buffers) {
+		FreeAligned(buffer);
+	}
+}
+
+long long Pipeline::Copy(FileSystem::File& source, FileSystem::File& destination, FileSystem::Progress const& progress) {
+	std::vector<FileSystem::File*> destinations(1, &destination);
+	std::vector<long long> results;
+	Copy(source, destinations, progress, results);
+	return results.front();
+}
+
+void Pipeline::Copy(FileSystem::File& source, std::vector<FileSystem::File*> const& destinations, FileSystem::Progress const& progress,
+	std::vector<long long>& results) {
+	results.assign(destinations.size(), -1);
+	if(destinations.empty()) {
+		return;
+	}
+	lengths.assign(buffers.size(), Empty);
+	blocks.assign(buffers.size(), 0);
+	remainingCounts.assign(buffers.size(), 0);
+	writerCount = destinations.size();
+	failed = false;
+	std::thread reader([this, &source, &progress] { Read(source, progress); });
+	std::vector<std::thread> writers;
+	for(size_t k = 1; k < destinations.size(); ++k) {
+		writers.push_back(std::thread([this, &destinations, &results, k] { results[k] = Write(*destinations[k]); }));
+	}
+	results[0] = Write(*destinations[0]);
+	for(auto& writer : writers) {
+		writer.join();
+	}
+	reader.join();
+}
+
+// Fill the buffers in order.  Stopping the progress fails the copy and
+// releases the writers.
+void Pipeline::Read(FileSystem::File& source, FileSystem::Progress const& progress) {
+	unsigned long long offset = 0;
+	for(unsigned long long block = 0;; ++block) {
+		size_t i = static_cast<size_t>(block % buffers.size());
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this, i] { return failed || lengths[i] == Empty; });
+			if(failed) {
+				return;
+			}
+		}
+
+		// Fill the buffer unless the file ends first.
+		size_t length = 0;
+		long long n = 0;
+		while(length < bufferSize && (n = source.Read(offset + length, buffers[i] + length, bufferSize - length)) > 0) {
+			length += static_cast<size_t>(n);
+			if(source.IsUnbuffered() && length % alignment != 0) {
+				// Only the end of an unbuffered file is a partial block.
+				n = 0;
+				break;
+			}
+		}
+
+		// An unbuffered file takes only whole blocks, so pad the last one for
+		// the writers, which fix the size afterward.
+		memset(buffers[i] + length, 0, Align(length) - length);
+		if(n >= 0 && length > 0 && progress && !progress(length)) {
+			n = -1;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if(n < 0) {
+				failed = true;
+			} else {
+				lengths[i] = length;
+				blocks[i] = block;
+				remainingCounts[i] = writerCount;
+			}
+		}
+		condition.notify_all();
+		if(n <= 0) {
+			return;
+		}
+		offset += length;
+	}
+}
+
+// Write the buffers in order as the reader fills them.  A short buffer
+// marks the end of the file.  A writer whose destination fails keeps
+// taking buffers so the others continue, unless it is the only one.
+long long Pipeline::Write(FileSystem::File& destination) {
+	unsigned long long offset = 0;
+	bool succeeded = true;
+	for(unsigned long long block = 0;; ++block) {
+		size_t i = static_cast<size_t>(block % buffers.size());
+		long long length;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this, i, block] { return failed || (lengths[i] != Empty && blocks[i] == block); });
+			if(failed) {
+				return -1;
+			}
+			length = lengths[i];
+		}
+		size_t size = destination.IsUnbuffered() ? Align(static_cast<size_t>(length)) : static_cast<size_t>(length);
+		bool isLast = static_cast<size_t>(length) < bufferSize;
+		succeeded = succeeded && (size == 0 || destination.Write(offset, buffers[i], size));
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if(!succeeded && writerCount == 1) {
+				failed = true;
+			} else if(--remainingCounts[i] == 0) {
+				lengths[i] = Empty;
+			}
+		}
+		condition.notify_all();
+		if(!succeeded && writerCount == 1) {
+			return -1;
+		}
+		offset += length;
+		if(isLast) {
+			break;
+		}
+	}
+	if(!succeeded || !destination.SetSize(offset)) {
+		return -1;
+	}
+	return static_cast<long long>(offset);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "FileSystem.h"
+
+// A pipeline copies a file through a ring of buffers.  A reader thread fills
+// the buffers ahead of the writers so reads from one device overlap writes
+// to others.  The buffers are aligned for unbuffered files.
+class Pipeline
+{
+public:
+	Pipeline(size_t bufferSize, unsigned depth);
+	~Pipeline();
+
+	// Copy the source from its start to the destination and set the
+	// destination's size.  Return the number of bytes copied or -1.  The
+	// reader reports its progress after each buffer.
+	long long Copy(FileSystem::File& source, FileSystem::File& destination, FileSystem::Progress const& progress);
+
+	// Copy the source to several destinations, reading it once.  A writer
+	// thread for each destination takes the buffers in order, and the reader
+	// refills a buffer once all writers wrote it.  Get the number of bytes
+	// copied to each destination, or -1 for those that failed.
+	void Copy(FileSystem::File& source, std::vector<FileSystem::File*> const& destinations, FileSystem::Progress const& progress,
+		std::vector<long long>& results);
+
+private:
+	size_t bufferSize;
+	std::vector<char*> buffers;
+
+	// Each slot holds the length read into its buffer, or Empty, the number
+	// of the block in it, and the number of writers yet to write it.
+	static long long const Empty = -1;
+	std::vector<long long> lengths;
+	std::vector<unsigned long long> blocks;
+	std::vector<size_t> remainingCounts;
+	size_t writerCount;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool failed;
+
+	void Read(FileSystem::File& source, FileSystem::Progress const& progress);
+	long long Write(FileSystem::File& destination);
+
+	Pipeline(Pipeline const&); // undefined
+	Pipeline& operator=(Pipeline const&); // undefined
+};
@@ -0,0 +1,118 @@
+#include "stdafx.h"
+#include "Poller.h"
+
+void Poller::Configure(Clock::duration minimumInterval, Clock::duration maximumInterval) {
+	this->minimumInterval = minimumInterval;
+	this->maximumInterval = std::max(minimumInterval, maximumInterval);
+}
+
+void Poller::SetFolders(std::set<tstring> const& folderPaths, Clock::time_point now) {
+	for(auto it = folders.begin(); it != folders.end();) {
+		if(folderPaths.find(it->first) == folderPaths.end()) {
+			it = folders.erase(it);
+		} else {
+			++it;
+		}
+	}
+	std::set<tstring> notifyingFolderPaths;
+	for(auto const& folderPath : folderPaths) {
+		if(folders.find(folderPath) != folders.end()) {
+			continue;
+		} else if(this->notifyingFolderPaths.count(folderPath) != 0) {
+			notifyingFolderPaths.insert(folderPath);
+			continue;
+		}
+		Folder& folder = folders[folderPath];
+		folder.interval = minimumInterval;
+		folder.dueTime = now;
+		folder.isListed = folder.isListing = folder.isClassified = false;
+		dues.push(Due(now, folderPath));
+	}
+	this->notifyingFolderPaths.swap(notifyingFolderPaths);
+}
+
+void Poller::TakeDue(Clock::time_point now, std::vector<std::pair<tstring, bool>>& folders) {
+	while(!dues.empty() && dues.top().first <= now) {
+		tstring folderPath = dues.top().second;
+		dues.pop();
+		auto it = this->folders.find(folderPath);
+		if(it != this->folders.end() && !it->second.isListing) {
+			it->second.isListing = true;
+			folders.push_back(std::make_pair(folderPath, !it->second.isClassified));
+		}
+	}
+}
+
+void Poller::Classify(tstring const& folderPath, bool hasChangeNotifications) {
+	auto it = folders.find(folderPath);
+	if(it == folders.end()) {
+		return;
+	} else if(hasChangeNotifications) {
+		// Its due time, if any, is now stale.
+		folders.erase(it);
+		notifyingFolderPaths.insert(folderPath);
+	} else {
+		it->second.isClassified = true;
+	}
+}
+
+void Poller::Update(tstring const& folderPath, std::vector<FileSystem::Item> const& items, bool isListed, Clock::time_point now,
+	std::vector<Watcher::Event>& events) {
+	auto it = folders.find(folderPath);
+	if(it == folders.end()) {
+		// The folder was removed while a worker listed it.
+		return;
+	}
+	Folder& folder = it->second;
+	folder.isListing = false;
+	bool hasChanges = false;
+	if(isListed) {
+		std::unordered_map<tstring, FileSystem::Info> newItems;
+		for(auto const& item : items) {
+			newItems[item.name] = item.info;
+		}
+		if(folder.isListed) {
+			// The first listing has nothing to compare with.
+			for(auto const& pair : newItems) {
+				auto old = folder.items.find(pair.first);
+				if(old == folder.items.end()) {
+					events.push_back(Watcher::Event{ folderPath, pair.first, Watcher::Added });
+				} else if(old->second.lastWriteTime != pair.second.lastWriteTime || old->second.size != pair.second.size) {
+					events.push_back(Watcher::Event{ folderPath, pair.first, Watcher::Modified });
+				} else {
+					continue;
+				}
+				hasChanges = true;
+			}
+			for(auto const& pair : folder.items) {
+				if(newItems.find(pair.first) == newItems.end()) {
+					events.push_back(Watcher::Event{ folderPath, pair.first, Watcher::Removed });
+					hasChanges = true;
+				}
+			}
+		}
+		folder.items.swap(newItems);
+		folder.isListed = true;
+	}
+	folder.interval = hasChanges ? minimumInterval : std::min(folder.interval * 2, maximumInterval);
+	folder.dueTime = now + folder.interval;
+	dues.push(Due(folder.dueTime, folderPath));
+}
+
+void Poller::Expect(tstring const& filePath, FileSystem::Info const& info) {
+	auto it = folders.find(FileSystem::GetFolder(filePath));
+	if(it != folders.end() && it->second.isListed) {
+		it->second.items[FileSystem::GetName(filePath)] = info;
+	}
+}
+
+int Poller::GetTimeout(Clock::time_point now) const {
+	if(dues.empty()) {
+		return Watcher::Infinite;
+	} else if(dues.top().first <= now) {
+		return 0;
+	}
+	auto duration = dues.top().first - now;
+	auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(duration + std::chrono::milliseconds(1) - Clock::duration(1));
+	return static_cast<int>(std::min<long long>(milliseconds.count(), INT_MAX));
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "FileSystem.h"
+#include "Watcher.h"
+
+// A poller finds changes in folders whose file systems do not report them,
+// such as network and FUSE mounts, by listing each folder periodically and
+// comparing the listings.  It lists a folder that changed again soon and
+// doubles the interval of one that did not, up to a maximum, so cold
+// folders cost little and no change waits longer than the maximum.
+class Poller
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	Poller() : minimumInterval(std::chrono::seconds(2)), maximumInterval(std::chrono::seconds(60)) {}
+	void Configure(Clock::duration minimumInterval, Clock::duration maximumInterval);
+
+	// Poll the folders of the set that need it.  New ones are due at once
+	// so their first listings give the contents to compare with.  Their
+	// file systems are not yet known; a worker determines them with the
+	// first listing since that might block on a network mount.
+	void SetFolders(std::set<tstring> const& folderPaths, Clock::time_point now);
+
+	// Append the folders due for listing and whether each still needs its
+	// file system determined.  A folder is not due again until its listing
+	// updates it.
+	void TakeDue(Clock::time_point now, std::vector<std::pair<tstring, bool>>& folders);
+
+	// Stop polling a folder whose file system reports its changes, or keep
+	// polling one whose file system does not.
+	void Classify(tstring const& folderPath, bool hasChangeNotifications);
+
+	// Compare a listing of a folder with the previous one and append events
+	// for the files that differ.  A failed listing changes nothing.
+	void Update(tstring const& folderPath, std::vector<FileSystem::Item> const& items, bool isListed, Clock::time_point now,
+		std::vector<Watcher::Event>& events);
+
+	// Take the information of a file the engine wrote as that of the last
+	// listing so the next one does not report the write.
+	void Expect(tstring const& filePath, FileSystem::Info const& info);
+
+	// Get the milliseconds until the next folder is due, or
+	// Watcher::Infinite if there are none.
+	int GetTimeout(Clock::time_point now) const;
+
+	size_t get_FolderCount() const { return folders.size(); }
+
+private:
+	struct Folder
+	{
+		std::unordered_map<tstring, FileSystem::Info> items;
+		Clock::duration interval;
+		Clock::time_point dueTime;
+		bool isListed, isListing, isClassified;
+	};
+	typedef std::pair<Clock::time_point, tstring> Due;
+
+	Clock::duration minimumInterval, maximumInterval;
+	std::map<tstring, Folder> folders;
+
+	// These are the folders known to report their changes.
+	std::set<tstring> notifyingFolderPaths;
+
+	// This holds a due time for each folder not being listed, ordered
+	// earliest first.  TakeDue skips the stale ones of removed folders.
+	std::priority_queue<Due, std::vector<Due>, std::greater<Due>> dues;
+};
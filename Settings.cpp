@@ -0,0 +1,374 @@
+#include "stdafx.h"
+#include "Hash.h"
+#include "Settings.h"
+
+#ifdef _WIN32
+static LPCTSTR const applicationDataFolderPath = _T("Adrezdi\\FileSync");
+
+tstring Settings::GetPath(bool createFolder) {
+	// Use the roaming user profile application data folder.
+	TCHAR path[MAX_PATH];
+	if(FAILED(SHGetFolderPath(NULL, CSIDL_APPDATA, NULL, 0, path)) || !PathAppend(path, applicationDataFolderPath)) {
+		return tstring();
+	}
+	if(createFolder && !FileSystem::CreateFolders(path)) {
+		return tstring();
+	}
+	return FileSystem::Combine(path, _T("Settings.dat"));
+}
+#else
+tstring Settings::GetPath(bool createFolder) {
+	// Use the XDG configuration folder.
+	tstring path;
+	char const* configurationPath = getenv("XDG_CONFIG_HOME");
+	if(configurationPath != nullptr && *configurationPath == '/') {
+		path = configurationPath;
+	} else {
+		char const* homePath = getenv("HOME");
+		if(homePath == nullptr || *homePath == '\0') {
+			return tstring();
+		}
+		path = FileSystem::Combine(homePath, ".config");
+	}
+	path = FileSystem::Combine(path, "FileSync");
+	if(createFolder && !FileSystem::CreateFolders(path)) {
+		return tstring();
+	}
+	return FileSystem::Combine(path, "Settings.dat");
+}
+#endif
+
+tstring Settings::GetTextPath() {
+	tstring path = GetPath(false);
+	return path.empty() ? path : FileSystem::Combine(FileSystem::GetFolder(path), _T("Settings.txt"));
+}
+
+// The store is a signature, a generation, and a record for each entry.  Its
+// journal, beside it, is a signature, the generation of the store to which
+// it applies, the end of its records, and a record for each change since
+// the store was written.  A record is a header followed by the two paths.
+namespace {
+	enum Operation { Add = 1, Remove = 2 };
+
+	struct Header
+	{
+		char signature[8];
+		unsigned long long generation;
+	};
+
+	// An edit writes its records past the end, then moves the end past
+	// them, so it need not read the journal and a crash cannot leave a
+	// partial record before the end.
+	struct JournalHeader
+	{
+		Header header;
+		unsigned long long end;
+	};
+
+	struct RecordHeader
+	{
+		unsigned int operation, flags, length1, length2;
+		unsigned long long checksum;
+	};
+
+	struct Record
+	{
+		tstring path1, path2;
+		unsigned flags;
+		bool isRemoved;
+	};
+}
+
+static char const storeSignature[8] = { 'F', 'S', 'S', 'T', 1, 0, 0, sizeof(TCHAR) };
+static char const journalSignature[8] = { 'F', 'S', 'S', 'J', 2, 0, 0, sizeof(TCHAR) };
+
+// Journals of this format have no end; their records run to the end of the
+// file.
+static char const oldJournalSignature[8] = { 'F', 'S', 'S', 'J', 1, 0, 0, sizeof(TCHAR) };
+static unsigned long long const minimumCompactionSize = 64 << 10;
+
+static tstring GetJournalPath(tstring const& path) {
+	return path + _T(".journal");
+}
+
+static tstring GetKey(tstring const& path1, tstring const& path2) {
+	return path1 + _T('\t') + path2;
+}
+
+static unsigned long long ComputeChecksum(RecordHeader const& header, void const* paths) {
+	Hash hash;
+	hash.Update(&header, offsetof(RecordHeader, checksum));
+	hash.Update(paths, (header.length1 + header.length2) * sizeof(TCHAR));
+	return hash.Finish();
+}
+
+// Read a whole file in one sequential read.
+static bool ReadAll(tstring const& path, std::vector<char>& data) {
+	std::ifstream fin(path.c_str(), std::ios::binary | std::ios::ate);
+	if(!fin) {
+		return false;
+	}
+	data.resize(static_cast<size_t>(fin.tellg()));
+	fin.seekg(0);
+	return data.empty() || !!fin.read(&data[0], data.size());
+}
+
+static bool ReadHeader(std::vector<char> const& data, char const* signature, unsigned long long& generation) {
+	Header header;
+	if(data.size() < sizeof(header)) {
+		return false;
+	}
+	memcpy(&header, &data[0], sizeof(header));
+	generation = header.generation;
+	return memcmp(header.signature, signature, sizeof(header.signature)) == 0;
+}
+
+// Read only the header of a file, which is all an edit needs of the store.
+static bool ReadHeader(FileSystem::File& file, char const* signature, unsigned long long& generation) {
+	Header header;
+	if(file.Read(0, &header, sizeof(header)) != static_cast<long long>(sizeof(header))) {
+		return false;
+	}
+	generation = header.generation;
+	return memcmp(header.signature, signature, sizeof(header.signature)) == 0;
+}
+
+static bool ReadHeader(tstring const& path, char const* signature, unsigned long long& generation) {
+	FileSystem::File file;
+	return file.Open(path, FileSystem::File::ReadOnly) && ReadHeader(file, signature, generation);
+}
+
+// Read the header of a journal with the end of its records.
+static bool ReadJournalHeader(FileSystem::File& file, unsigned long long& generation, unsigned long long& end) {
+	JournalHeader header;
+	if(file.Read(0, &header, sizeof(header)) != static_cast<long long>(sizeof(header))) {
+		return false;
+	}
+	generation = header.header.generation;
+	end = header.end;
+	return memcmp(header.header.signature, journalSignature, sizeof(header.header.signature)) == 0 && end >= sizeof(header);
+}
+
+// Apply the records between the offset and the end, stopping at the first
+// incomplete or corrupt one.  Without an index, the records are those of a
+// store, which has each entry once, so append them all.
+static void ApplyRecords(std::vector<char> const& data, size_t offset, size_t end, std::vector<Record>& records,
+	std::unordered_map<tstring, size_t>* indices) {
+	RecordHeader header;
+	while(end - offset >= sizeof(header)) {
+		memcpy(&header, &data[offset], sizeof(header));
+		offset += sizeof(header);
+		size_t length = (static_cast<size_t>(header.length1) + header.length2) * sizeof(TCHAR);
+		if(header.length1 == 0 || header.length2 == 0 || end - offset < length) {
+			break;
+		}
+		if(ComputeChecksum(header, &data[offset]) != header.checksum) {
+			break;
+		}
+		tstring path1(header.length1, 0), path2(header.length2, 0);
+		memcpy(&path1[0], &data[offset], header.length1 * sizeof(TCHAR));
+		memcpy(&path2[0], &data[offset + header.length1 * sizeof(TCHAR)], header.length2 * sizeof(TCHAR));
+		offset += length;
+		if(indices == nullptr) {
+			if(header.operation == Add) {
+				Record record = { std::move(path1), std::move(path2), header.flags, false };
+				records.push_back(std::move(record));
+			}
+			continue;
+		}
+		tstring key = GetKey(path1, path2);
+		auto it = indices->find(key);
+		if(header.operation == Add) {
+			if(it == indices->end()) {
+				Record record = { path1, path2, header.flags, false };
+				(*indices)[key] = records.size();
+				records.push_back(record);
+			} else {
+				records[it->second].flags = header.flags;
+			}
+		} else if(header.operation == Remove && it != indices->end()) {
+			records[it->second].isRemoved = true;
+			indices->erase(it);
+		}
+	}
+}
+
+// Read the records of a store and apply its journal.  Index the records by
+// their paths only if the journal has records to apply.
+static bool ReadStore(tstring const& path, std::vector<Record>& records, unsigned long long& generation) {
+	std::vector<char> data;
+	if(!ReadAll(path, data) || !ReadHeader(data, storeSignature, generation)) {
+		return false;
+	}
+	records.reserve(data.size() / (sizeof(RecordHeader) + 64 * sizeof(TCHAR)));
+	ApplyRecords(data, sizeof(Header), data.size(), records, nullptr);
+	unsigned long long journalGeneration;
+	size_t offset = 0, end = 0;
+	if(!ReadAll(GetJournalPath(path), data)) {
+		return true;
+	} else if(ReadHeader(data, journalSignature, journalGeneration) && journalGeneration == generation && data.size() >= sizeof(JournalHeader)) {
+		JournalHeader header;
+		memcpy(&header, &data[0], sizeof(header));
+		offset = sizeof(header);
+		end = static_cast<size_t>(std::min<unsigned long long>(header.end, data.size()));
+	} else if(ReadHeader(data, oldJournalSignature, journalGeneration) && journalGeneration == generation) {
+		offset = sizeof(Header);
+		end = data.size();
+	}
+	if(end > offset) {
+		std::unordered_map<tstring, size_t> indices;
+		indices.reserve(records.size());
+		for(size_t i = 0; i < records.size(); ++i) {
+			indices[GetKey(records[i].path1, records[i].path2)] = i;
+		}
+		ApplyRecords(data, offset, end, records, &indices);
+	}
+	return true;
+}
+
+static void WriteHeader(std::ostream& out, char const* signature, unsigned long long generation) {
+	Header header;
+	memcpy(header.signature, signature, sizeof(header.signature));
+	header.generation = generation;
+	out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+}
+
+static void WriteRecord(std::ostream& out, Operation operation, tstring const& path1, tstring const& path2, unsigned flags) {
+	tstring paths = path1 + path2;
+	RecordHeader header = { static_cast<unsigned int>(operation), flags, static_cast<unsigned int>(path1.size()), static_cast<unsigned int>(path2.size()), 0 };
+	header.checksum = ComputeChecksum(header, paths.data());
+	out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+	out.write(reinterpret_cast<char const*>(paths.data()), paths.size() * sizeof(TCHAR));
+}
+
+// Write a store of the next generation and replace the old one with it.  A
+// crash after the replacement leaves the old journal, which no longer
+// applies because of the generation.
+static bool WriteStore(tstring const& path, std::vector<Record> const& records) {
+	unsigned long long generation;
+	if(!ReadHeader(path, storeSignature, generation)) {
+		generation = 0;
+	}
+	++generation;
+	tstring temporaryPath = path + _T(".new");
+	{
+		std::ofstream fout(temporaryPath.c_str(), std::ios::binary | std::ios::trunc);
+		WriteHeader(fout, storeSignature, generation);
+		for(auto const& record : records) {
+			if(!record.isRemoved) {
+				WriteRecord(fout, Add, record.path1, record.path2, record.flags);
+			}
+		}
+		fout.close();
+		if(fout.fail()) {
+			return false;
+		}
+	}
+	if(!FileSystem::Replace(temporaryPath, path)) {
+		return false;
+	}
+	std::ofstream fout(GetJournalPath(path).c_str(), std::ios::binary | std::ios::trunc);
+	WriteHeader(fout, journalSignature, generation);
+	unsigned long long end = sizeof(JournalHeader);
+	fout.write(reinterpret_cast<char const*>(&end), sizeof(end));
+	fout.close();
+	return !fout.fail();
+}
+
+static bool LoadText(tstring const& path, std::vector<Entry>& entries) {
+	tifstream fin(path.c_str());
+	if(!fin) {
+		return false;
+	}
+	tstring line;
+	while(std::getline(fin, line)) {
+		Entry entry;
+		if(!entry.CreateFromString(line)) {
+			break;
+		}
+		entries.push_back(entry);
+	}
+	return true;
+}
+
+bool Settings::Load(tstring const& path, std::vector<Entry>& entries) {
+	std::vector<Record> records;
+	unsigned long long generation;
+	if(!ReadStore(path, records, generation)) {
+		return LoadText(path, entries);
+	}
+	entries.reserve(entries.size() + records.size());
+	for(auto const& record : records) {
+		Entry entry;
+		if(!record.isRemoved && entry.CreateFromPaths(record.path1, record.path2, record.flags)) {
+			entries.push_back(entry);
+		}
+	}
+	return true;
+}
+
+bool Settings::Save(tstring const& path, std::vector<Entry> const& entries) {
+	std::vector<Record> records;
+	records.reserve(entries.size());
+	for(auto const& entry : entries) {
+		Record record = { entry.get_Path1(), entry.get_Path2(), entry.get_Flags(), false };
+		records.push_back(record);
+	}
+	return WriteStore(path, records);
+}
+
+bool Settings::Update(tstring const& path, std::vector<Entry> const& previousEntries, std::vector<Entry> const& entries) {
+	// Find the entries removed and added.  Changing the flags of an entry
+	// removes and adds it.
+	std::unordered_map<tstring, unsigned> counts;
+	for(auto const& entry : previousEntries) {
+		++counts[GetKey(entry.get_Path1(), entry.get_Path2()) + static_cast<TCHAR>(_T('0') + entry.get_Flags())];
+	}
+	std::vector<Entry const*> addedEntries;
+	for(auto const& entry : entries) {
+		auto it = counts.find(GetKey(entry.get_Path1(), entry.get_Path2()) + static_cast<TCHAR>(_T('0') + entry.get_Flags()));
+		if(it != counts.end() && it->second > 0) {
+			--it->second;
+		} else {
+			addedEntries.push_back(&entry);
+		}
+	}
+
+	// Append the changes to the journal of the current store.  Rewrite the
+	// store instead if the journal is missing, of the previous format, or
+	// of another generation.
+	unsigned long long generation, journalGeneration, end;
+	tstring journalPath = GetJournalPath(path);
+	FileSystem::File journal;
+	if(!ReadHeader(path, storeSignature, generation) || !journal.Open(journalPath, FileSystem::File::ReadWrite)
+		|| !ReadJournalHeader(journal, journalGeneration, end) || journalGeneration != generation) {
+		return Save(path, entries);
+	}
+	std::ostringstream out;
+	for(auto const& entry : previousEntries) {
+		auto it = counts.find(GetKey(entry.get_Path1(), entry.get_Path2()) + static_cast<TCHAR>(_T('0') + entry.get_Flags()));
+		if(it->second > 0) {
+			--it->second;
+			WriteRecord(out, Remove, entry.get_Path1(), entry.get_Path2(), entry.get_Flags());
+		}
+	}
+	for(auto entry : addedEntries) {
+		WriteRecord(out, Add, entry->get_Path1(), entry->get_Path2(), entry->get_Flags());
+	}
+	std::string data = out.str();
+	if(!journal.Write(end, data.data(), data.size())) {
+		return false;
+	}
+	end += data.size();
+	if(!journal.Write(offsetof(JournalHeader, end), &end, sizeof(end)) || !journal.Close()) {
+		return false;
+	}
+
+	// Compact the journal once it is larger than the store.
+	FileSystem::Info storeInfo;
+	if(FileSystem::GetInfo(path, storeInfo) && end > minimumCompactionSize && end > storeInfo.size) {
+		std::vector<Record> records;
+		return ReadStore(path, records, generation) && WriteStore(path, records);
+	}
+	return true;
+}
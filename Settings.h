@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Entry.h"
+
+namespace Settings
+{
+	// Get the path of the settings store, optionally creating its folder.
+	tstring GetPath(bool createFolder);
+
+	// Get the path of the text settings file of earlier versions.
+	tstring GetTextPath();
+
+	// Load entries from a settings store and its journal or from a text
+	// settings file until the first line that fails to load.  This does not
+	// look at the files of the entries.
+	bool Load(tstring const& path, std::vector<Entry>& entries);
+
+	// Write all entries to a new store, discarding its journal.
+	bool Save(tstring const& path, std::vector<Entry> const& entries);
+
+	// Append the differences between the previous and current entries to
+	// the store's journal.  Compact the journal into the store once it
+	// outgrows it.
+	bool Update(tstring const& path, std::vector<Entry> const& previousEntries, std::vector<Entry> const& entries);
+};
@@ -0,0 +1,107 @@
+#include "stdafx.h"
+#include "Benchmark.h"
+#include "Settings.h"
+
+// This measures loading text settings files of increasing sizes, saving
+// them as a store, loading the store, and recording one change in its
+// journal.
+
+using Benchmark::Clock;
+
+// Run an operation a number of times and get its shortest time in
+// milliseconds.
+template<typename F>
+static double MeasureBest(unsigned repeatCount, F operation) {
+	double best = 0;
+	for(unsigned i = 0; i < repeatCount; ++i) {
+		Clock::time_point start = Clock::now();
+		if(!operation()) {
+			return -1;
+		}
+		double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		best = i == 0 ? milliseconds : std::min(best, milliseconds);
+	}
+	return best;
+}
+
+static bool Measure(tstring const& rootPath, size_t lineCount, unsigned repeatCount) {
+	// Write lines like those of a typical configuration.
+	tstring textPath = FileSystem::Combine(rootPath, "Settings-" + std::to_string(lineCount) + ".txt");
+	tstring storePath = FileSystem::Combine(rootPath, "Settings-" + std::to_string(lineCount) + ".dat");
+	{
+		std::ofstream fout(textPath.c_str(), std::ios::trunc);
+		for(size_t i = 0; i < lineCount; ++i) {
+			tstring path1 = "/home/user/Documents/projects/folder-" + std::to_string(i % 1000) + "/document-" + std::to_string(i) + ".txt";
+			fout << path1 << '\t' << "/mnt/backup" << path1 << '\t' << i % 2 << '\n';
+		}
+		if(!fout) {
+			fprintf(stderr, "cannot write %s\n", textPath.c_str());
+			return false;
+		}
+	}
+
+	std::vector<Entry> entries;
+	double textTime = MeasureBest(repeatCount, [&] {
+		entries.clear();
+		return Settings::Load(textPath, entries) && entries.size() == lineCount;
+	});
+	double saveTime = MeasureBest(repeatCount, [&] { return Settings::Save(storePath, entries); });
+	std::vector<Entry> storeEntries;
+	double storeTime = MeasureBest(repeatCount, [&] {
+		storeEntries.clear();
+		return Settings::Load(storePath, storeEntries) && storeEntries.size() == lineCount;
+	});
+
+	// Add and remove an entry so the journal stays small.
+	std::vector<Entry> changedEntries = entries;
+	changedEntries.push_back(Entry());
+	changedEntries.back().CreateFromPaths("/home/user/new.txt", "/mnt/backup/home/user/new.txt", 0);
+	bool isAdded = false;
+	double updateTime = MeasureBest(repeatCount, [&] {
+		isAdded = !isAdded;
+		return isAdded ? Settings::Update(storePath, entries, changedEntries) : Settings::Update(storePath, changedEntries, entries);
+	});
+	if(textTime < 0 || saveTime < 0 || storeTime < 0 || updateTime < 0) {
+		fprintf(stderr, "cannot measure %u lines\n", (unsigned)lineCount);
+		return false;
+	}
+	printf("  %8u %10.3f %10.3f %10.3f %10.3f %10.1f %10.1f %8.1f\n", (unsigned)lineCount, textTime, saveTime, storeTime, updateTime,
+		textTime * 1e6 / lineCount, storeTime * 1e6 / lineCount, Benchmark::GetPeakResidentSize() / 1024.0);
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	std::vector<size_t> lineCounts = { 10, 100, 1000, 10000, 100000 };
+	unsigned repeatCount = 5;
+	int option;
+	while((option = getopt(argc, argv, "n:r:")) != -1) {
+		switch(option) {
+		case 'n':
+			lineCounts.assign(1, std::max(strtoul(optarg, nullptr, 10), 1ul));
+			break;
+		case 'r':
+			repeatCount = std::max(strtoul(optarg, nullptr, 10), 1ul);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n line-count] [-r repeat-count] [folder]\n", argv[0]);
+			return 2;
+		}
+	}
+	tstring parentPath = optind < argc ? argv[optind] : "/tmp", rootPath;
+	if(!Benchmark::MakeTemporaryFolder(parentPath, "SettingsBenchmark", rootPath)) {
+		return 1;
+	}
+
+	printf("# best of %u runs in milliseconds; per-line times in nanoseconds\n", repeatCount);
+	printf("# %6s %10s %10s %10s %10s %10s %10s %8s\n", "lines", "load text", "save", "load store", "update", "text/line", "store/line", "peak MB");
+	setvbuf(stdout, nullptr, _IOLBF, 0);
+	bool succeeded = true;
+	for(size_t lineCount : lineCounts) {
+		if(!Measure(rootPath, lineCount, repeatCount)) {
+			succeeded = false;
+			break;
+		}
+	}
+	Benchmark::RemoveFolder(rootPath);
+	return succeeded ? 0 : 1;
+}
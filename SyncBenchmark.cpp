@@ -0,0 +1,135 @@
+#include "stdafx.h"
+#include "Benchmark.h"
+#include "SyncEngine.h"
+#include <random>
+
+// This runs the engine against synthetic workloads and reports the copy
+// throughput, the latency from a change to its copy, the read and write
+// system calls of the engine per watcher event, and the peak resident size.
+
+using Benchmark::Clock;
+
+// A workload spreads entries over folders and writes some of their main
+// files, the targets, a number of times each.
+struct Workload
+{
+	char const* name;
+	size_t entryCount, folderCount, targetCount, writeCount, fileSize;
+};
+
+static Workload const workloads[] = {
+	{ "entries", 10000, 100, 1000, 1, 4 << 10 },
+	{ "burst", 100, 10, 100, 20, 4 << 10 },
+	{ "large", 4, 1, 4, 1, 64 << 20 },
+	{ "storm", 5000, 1, 5000, 1, 512 },
+};
+
+static bool Measure(tstring const& rootPath, Workload const& workload, std::chrono::milliseconds quietTime, unsigned workerCount) {
+	// Create the files of the entries in parallel main and backup folders.
+	std::vector<char> contents(workload.fileSize, 'x');
+	std::vector<Entry> entries(workload.entryCount);
+	for(size_t i = 0; i < workload.entryCount; ++i) {
+		tstring folderName = "folder-" + std::to_string(i % workload.folderCount), name = "file-" + std::to_string(i);
+		tstring folderPath1 = FileSystem::Combine(FileSystem::Combine(rootPath, "main"), folderName);
+		tstring folderPath2 = FileSystem::Combine(FileSystem::Combine(rootPath, "backup"), folderName);
+		tstring path1 = FileSystem::Combine(folderPath1, name), path2 = FileSystem::Combine(folderPath2, name);
+		if(!FileSystem::CreateFolders(folderPath1) || !FileSystem::CreateFolders(folderPath2) || !Benchmark::WriteFile(path1, contents.data(), contents.size())
+			|| !Benchmark::WriteFile(path2, contents.data(), contents.size())) {
+			fprintf(stderr, "cannot create %s\n", path1.c_str());
+			return false;
+		}
+		entries[i].CreateFromPaths(path1, path2, 0);
+	}
+
+	SyncEngine engine;
+	engine.ConfigureCoalescing(quietTime, quietTime * 10);
+	engine.ConfigureWorkers(workerCount, 4);
+	engine.Start(entries);
+
+	// Let the engine collect the state of the entries.
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+	// Write each target with new contents, then wait for its copy.  Count
+	// the system calls of the other threads, which are the engine's.
+	std::mt19937 random(static_cast<unsigned>(workload.entryCount));
+	std::vector<size_t> targets(workload.entryCount);
+	for(size_t i = 0; i < targets.size(); ++i) {
+		targets[i] = i;
+	}
+	std::shuffle(targets.begin(), targets.end(), random);
+	targets.resize(std::min(workload.targetCount, targets.size()));
+	Metrics const& metrics = engine.get_Metrics();
+	unsigned long long ioCallCount = Benchmark::GetIoCallCount(false) - Benchmark::GetIoCallCount(true);
+	Clock::time_point start = Clock::now();
+	for(size_t write = 0; write < workload.writeCount; ++write) {
+		contents[0] = static_cast<char>('a' + write % 26);
+		for(size_t i : targets) {
+			if(!Benchmark::WriteFile(entries[i].get_Path1(), contents.data(), contents.size())) {
+				fprintf(stderr, "cannot write %s\n", entries[i].get_Path1().c_str());
+				return false;
+			}
+		}
+	}
+	Clock::time_point deadline = start + std::chrono::minutes(2);
+	while(metrics.get_Counter(Metrics::Copies) < targets.size() && Clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	ioCallCount = Benchmark::GetIoCallCount(false) - Benchmark::GetIoCallCount(true) - ioCallCount;
+	engine.Stop();
+
+	unsigned long long copyCount = metrics.get_Counter(Metrics::Copies), eventCount = metrics.get_Counter(Metrics::Events);
+	Histogram const& latencies = metrics.get_Histogram(Metrics::ChangeToCopy);
+	printf("  %-8s %8u %8llu %8.2f %10.0f %8.1f %8.1f %8.1f %8.1f %8.1f %8llu %8.1f %8.1f\n", workload.name, (unsigned)workload.entryCount, copyCount,
+		seconds, copyCount / seconds, workload.fileSize * static_cast<double>(copyCount) / seconds / (1 << 20),
+		latencies.GetPercentile(0.5) / 1000.0, latencies.GetPercentile(0.9) / 1000.0, latencies.GetPercentile(0.99) / 1000.0,
+		latencies.get_Maximum() / 1000.0, eventCount, eventCount == 0 ? 0.0 : static_cast<double>(ioCallCount) / eventCount,
+		Benchmark::GetPeakResidentSize() / 1024.0);
+	if(copyCount < targets.size()) {
+		fprintf(stderr, "%s copied %llu of %u files\n", workload.name, copyCount, (unsigned)targets.size());
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	char const* workloadName = nullptr;
+	std::chrono::milliseconds quietTime(20);
+	unsigned workerCount = 0;
+	int option;
+	while((option = getopt(argc, argv, "q:t:w:")) != -1) {
+		switch(option) {
+		case 'q':
+			quietTime = std::chrono::milliseconds(strtoul(optarg, nullptr, 10));
+			break;
+		case 't':
+			workerCount = strtoul(optarg, nullptr, 10);
+			break;
+		case 'w':
+			workloadName = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-w entries|burst|large|storm] [-q quiet-milliseconds] [-t worker-count] [folder]\n", argv[0]);
+			return 2;
+		}
+	}
+	tstring parentPath = optind < argc ? argv[optind] : "/tmp";
+
+	printf("# latencies in milliseconds from the first write to the end of the copy\n");
+	printf("# %-8s %8s %8s %8s %10s %8s %8s %8s %8s %8s %8s %8s %8s\n", "workload", "entries", "copies", "seconds", "copies/s", "MB/s", "p50", "p90",
+		"p99", "max", "events", "io/event", "peak MB");
+	setvbuf(stdout, nullptr, _IOLBF, 0);
+	bool succeeded = true;
+	for(auto const& workload : workloads) {
+		if(workloadName != nullptr && strcmp(workloadName, workload.name) != 0) {
+			continue;
+		}
+		tstring rootPath;
+		if(!Benchmark::MakeTemporaryFolder(parentPath, "SyncBenchmark", rootPath)) {
+			return 1;
+		}
+		succeeded = Measure(rootPath, workload, quietTime, workerCount) && succeeded;
+		Benchmark::RemoveFolder(rootPath);
+	}
+	return succeeded ? 0 : 1;
+}
@@ -0,0 +1,615 @@
+#include "stdafx.h"
+#include "SyncEngine.h"
+
+SyncEngine::SyncEngine() : walker(0), workerCount(), synchronizationCount(), copyCount(), enabled(true), nextGeneration(), stopping(false) {
+	copier.SetMetrics(&metrics);
+	copier.SetEchoFilter(&echoes);
+}
+
+SyncEngine::~SyncEngine() {
+	Stop();
+}
+
+void SyncEngine::Start(std::vector<Entry> const& entries) {
+	ASSERT(!thread.joinable());
+	watcher = Watcher::Create();
+	stopping = false;
+	SetEntries(entries);
+	pool.Start(workerCount);
+	thread = std::thread(&SyncEngine::Run, this);
+}
+
+void SyncEngine::Stop() {
+	if(thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		watcher->Wake();
+		thread.join();
+
+		// Wait for the copies in progress.
+		pool.Stop();
+		snapshot.reset();
+		pendingSnapshot.reset();
+		schedules.clear();
+		treeChanges.clear();
+		folderPaths.clear();
+		treeFolderPaths.clear();
+		forwardIndices.clear();
+		taskCounts.clear();
+		finishedEntries.clear();
+		collectedInfo.clear();
+		polledFolders.clear();
+		echoes.Clear();
+		poller.SetFolders(folderPaths, Poller::Clock::now());
+		copier.Flush();
+	}
+}
+
+// Build the snapshot on the calling thread so the engine thread need only
+// swap it in.
+void SyncEngine::SetEntries(std::vector<Entry> const& entries) {
+	std::shared_ptr<Snapshot> newSnapshot = std::make_shared<Snapshot>();
+	newSnapshot->table.Build(entries);
+	newSnapshot->index.Build(entries);
+	for(auto const& entry : entries) {
+		entry.AddFolder(newSnapshot->folderPaths);
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		newSnapshot->generation = nextGeneration++;
+		pendingSnapshot = newSnapshot;
+	}
+	if(watcher) {
+		watcher->Wake();
+	}
+}
+
+// Publish the snapshot given to SetEntries and watch its folders.  Only the
+// engine thread calls this.
+void SyncEngine::ApplyPendingEntries() {
+	std::shared_ptr<Snapshot> newSnapshot;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		newSnapshot.swap(pendingSnapshot);
+	}
+	if(!newSnapshot) {
+		return;
+	}
+
+	// An entry for the same files as an old one takes its state, schedule,
+	// and pending tree changes, including a synchronization in progress.
+	// The workers collect the state of the other file entries.  Compare new
+	// trees entirely to find their folders.
+	EntryTable& newTable = newSnapshot->table;
+	size_t count = newTable.get_Count();
+	std::vector<Schedule> newSchedules(count, Schedule());
+	std::map<size_t, std::set<tstring>> newTreeChanges;
+	std::vector<bool> isMatched(count);
+	if(snapshot) {
+		std::map<std::pair<tstring, tstring>, size_t> newIndices;
+		for(size_t i = 0; i < count; ++i) {
+			newIndices[std::make_pair(newTable.get_Path1(i), newTable.get_Path2(i))] = i;
+		}
+		EntryTable const& table = snapshot->table;
+		std::vector<size_t> forward(table.get_Count(), std::string::npos);
+		for(size_t j = 0; j < table.get_Count(); ++j) {
+			auto it = newIndices.find(std::make_pair(table.get_Path1(j), table.get_Path2(j)));
+			if(it != newIndices.end()) {
+				size_t i = it->second;
+				forward[j] = i;
+				isMatched[i] = true;
+				newTable.TakeState(i, table, j);
+				newSchedules[i] = schedules[j];
+				auto changes = treeChanges.find(j);
+				if(changes != treeChanges.end()) {
+					newTreeChanges[i].swap(changes->second);
+				}
+			}
+		}
+		if(!taskCounts.empty()) {
+			forwardIndices[snapshot->generation].swap(forward);
+		}
+	}
+	std::vector<size_t> collectIndices;
+	std::vector<tstring> treeRootPaths;
+	for(size_t i = 0; i < count; ++i) {
+		if(isMatched[i]) {
+			if(newTable.IsTree(i)) {
+				treeRootPaths.push_back(newTable.get_Path1(i));
+				treeRootPaths.push_back(newTable.get_Path2(i));
+			}
+		} else if(newTable.IsTree(i)) {
+			newTreeChanges[i].insert(tstring());
+			newSchedules[i].isDirty = true;
+		} else {
+			collectIndices.push_back(i);
+		}
+	}
+	snapshot = newSnapshot;
+	schedules.swap(newSchedules);
+	treeChanges.swap(newTreeChanges);
+	CollectInfo(collectIndices);
+
+	// Keep the folders found in the trees that remain so the watcher need
+	// only add and remove the difference.
+	std::set<tstring> keptFolderPaths;
+	for(auto const& rootPath : treeRootPaths) {
+		tstring prefix = FileSystem::Combine(rootPath, tstring());
+		for(auto it = treeFolderPaths.lower_bound(prefix); it != treeFolderPaths.end() && it->compare(0, prefix.size(), prefix) == 0; ++it) {
+			keptFolderPaths.insert(*it);
+		}
+	}
+	treeFolderPaths.swap(keptFolderPaths);
+	folderPaths = snapshot->folderPaths;
+	folderPaths.insert(treeFolderPaths.begin(), treeFolderPaths.end());
+	WatchFolders();
+	std::vector<size_t> dirtyIndices;
+	for(size_t i = 0; i < count; ++i) {
+		if(schedules[i].isDirty && !schedules[i].isBusy && IsLive(i) && enabled) {
+			dirtyIndices.push_back(i);
+		}
+	}
+	DispatchAll(dirtyIndices);
+}
+
+// Release the entries the workers finished and run again those that
+// changed while they were busy.
+void SyncEngine::ApplyFinishedEntries() {
+	std::vector<Finished> finished;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		finished.swap(finishedEntries);
+	}
+	std::vector<size_t> indices;
+	bool hasNewFolders = false;
+	for(auto const& item : finished) {
+		size_t i = MapIndex(item.generation, item.index);
+		FinishTask(item.generation);
+		indices.push_back(i);
+		if(i == std::string::npos) {
+			// The entry was removed while its worker was busy.
+			continue;
+		}
+		snapshot->table.SetState(i, item.state);
+		for(auto const& folderPath : item.folderPaths) {
+			if(treeFolderPaths.insert(folderPath).second) {
+				hasNewFolders = folderPaths.insert(folderPath).second || hasNewFolders;
+			}
+		}
+	}
+	if(hasNewFolders) {
+		WatchFolders();
+	}
+
+	// Look at the files still being written again later.
+	Coalescer::Clock::time_point now = Coalescer::Clock::now();
+	for(auto const& item : finished) {
+		for(auto const& filePath : item.deferredPaths) {
+			if(enabled) {
+				Watcher::Event event = { FileSystem::GetFolder(filePath), FileSystem::GetName(filePath), Watcher::Modified };
+				coalescer.Hold(event, now + copier.get_Options().stabilityTime, now);
+			}
+		}
+	}
+	std::vector<size_t> dirtyIndices;
+	for(size_t k = 0; k < finished.size(); ++k) {
+		size_t i = indices[k];
+		if(i == std::string::npos) {
+			continue;
+		}
+		schedules[i].isBusy = false;
+		schedules[i].cancellation.reset();
+		if(finished[k].copyCount > 0 && schedules[i].busyChangeTime != Coalescer::Clock::time_point()) {
+			metrics.Record(Metrics::ChangeToCopy, now - schedules[i].busyChangeTime);
+		}
+		schedules[i].busyChangeTime = Coalescer::Clock::time_point();
+		if(schedules[i].isDirty && enabled) {
+			dirtyIndices.push_back(i);
+		}
+	}
+	DispatchAll(dirtyIndices);
+}
+
+// Watch the folders, and poll those whose file systems do not report
+// changes.
+void SyncEngine::WatchFolders() {
+	watcher->SetFolders(folderPaths);
+	poller.SetFolders(folderPaths, Poller::Clock::now());
+}
+
+// List the folders due for polling on the workers.
+void SyncEngine::PollDueFolders() {
+	std::vector<std::pair<tstring, bool>> dueFolders;
+	poller.TakeDue(Poller::Clock::now(), dueFolders);
+	for(auto const& folder : dueFolders) {
+		pool.Submit(std::bind(&SyncEngine::Poll, this, folder.first, folder.second), std::vector<FileSystem::Device>());
+	}
+}
+
+// List a polled folder on a worker thread and tell the engine thread.
+// First determine whether its file system reports changes if asked, since
+// that can block on a network mount as a listing can.
+void SyncEngine::Poll(tstring const& folderPath, bool isClassifying) {
+	Polled polled = { folderPath, std::vector<FileSystem::Item>(), false, isClassifying, false };
+	if(isClassifying) {
+		polled.hasChangeNotifications = FileSystem::HasChangeNotifications(folderPath);
+	}
+	if(!polled.hasChangeNotifications) {
+		polled.isListed = FileSystem::ListFolder(folderPath, polled.items);
+		metrics.Increment(Metrics::Polls);
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		polledFolders.push_back(std::move(polled));
+	}
+	watcher->Wake();
+}
+
+// Treat the differences the workers found in polled folders like the
+// watcher's events.
+void SyncEngine::ApplyPolledFolders() {
+	std::vector<Polled> polled;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		polled.swap(polledFolders);
+	}
+	Coalescer::Clock::time_point now = Coalescer::Clock::now();
+	std::vector<Watcher::Event> events;
+	for(auto const& item : polled) {
+		if(item.isClassified) {
+			poller.Classify(item.folderPath, item.hasChangeNotifications);
+		}
+		poller.Update(item.folderPath, item.items, item.isListed, now, events);
+	}
+	if(!events.empty() && enabled) {
+		metrics.Add(Metrics::Events, events.size());
+		AddEvents(events, now);
+	}
+}
+
+// Hold the events for the coalescer except the echoes of the workers'
+// own writes.
+void SyncEngine::AddEvents(std::vector<Watcher::Event> const& events, Coalescer::Clock::time_point now) {
+	for(auto const& event : events) {
+		if(echoes.IsEcho(event)) {
+			metrics.Increment(Metrics::Echoes);
+		} else {
+			coalescer.Add(event, now);
+		}
+	}
+}
+
+// Forget the writes whose echoes the watcher reported and give the poller
+// their results so its next listings do not report them either.
+void SyncEngine::ExpireEchoes(EchoFilter::Clock::time_point time) {
+	std::vector<std::pair<tstring, FileSystem::Info>> writes;
+	echoes.Expire(time, writes);
+	for(auto const& write : writes) {
+		poller.Expect(write.first, write.second);
+	}
+}
+
+void SyncEngine::StartTask(unsigned generation) {
+	++taskCounts[generation];
+}
+
+void SyncEngine::FinishTask(unsigned generation) {
+	auto it = taskCounts.find(generation);
+	if(--it->second == 0) {
+		taskCounts.erase(it);
+	}
+
+	// Forget the maps of generations no task refers to.
+	unsigned oldestGeneration = taskCounts.empty() ? snapshot->generation : taskCounts.begin()->first;
+	forwardIndices.erase(forwardIndices.begin(), forwardIndices.lower_bound(oldestGeneration));
+}
+
+// Follow the entry of a task through the snapshots published since the
+// task started.  Every generation since then has a map.
+size_t SyncEngine::MapIndex(unsigned generation, size_t i) const {
+	for(auto it = forwardIndices.find(generation); it != forwardIndices.end() && i != std::string::npos; ++it) {
+		i = it->second[i];
+	}
+	return i;
+}
+
+// Hand the workers the files of new entries by folder so one listing of a
+// folder serves all of its entries.  Entries in different folders become
+// live as their folders finish rather than waiting for the slowest one.
+void SyncEngine::CollectInfo(std::vector<size_t> const& indices) {
+	EntryTable const& table = snapshot->table;
+	std::map<tstring, std::vector<InfoRequest>> folders;
+	for(size_t i : indices) {
+		for(unsigned side = 1; side <= 2; ++side) {
+			tstring path = side == 1 ? table.get_Path1(i) : table.get_Path2(i);
+			InfoRequest request = { i, side, FileSystem::GetName(path) };
+			folders[FileSystem::GetKey(FileSystem::GetFolder(path))].push_back(request);
+		}
+		schedules[i].collectingCount = 2;
+	}
+	for(auto const& pair : folders) {
+		StartTask(snapshot->generation);
+		pool.Submit(std::bind(&SyncEngine::Collect, this, snapshot->generation, pair.first, pair.second), std::vector<FileSystem::Device>());
+	}
+}
+
+// Collect the state of files in one folder on a worker thread.  Look up
+// only the requested files so a large folder costs no more than a small
+// one.  A folder in place of a file counts as missing.
+void SyncEngine::Collect(unsigned generation, tstring const& folderPath, std::vector<InfoRequest> const& requests) {
+	std::vector<tstring> names;
+	names.reserve(requests.size());
+	for(auto const& request : requests) {
+		names.push_back(request.name);
+	}
+	std::vector<FileSystem::Info> infos;
+	std::vector<bool> found;
+	FileSystem::GetInfos(folderPath, names, infos, found);
+	std::vector<InfoResult> results;
+	results.reserve(requests.size());
+	for(size_t k = 0; k < requests.size(); ++k) {
+		InfoResult result = { requests[k].index, requests[k].side, found[k] && !infos[k].isFolder, infos[k] };
+		results.push_back(result);
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		collectedInfo.push_back(Collected());
+		collectedInfo.back().generation = generation;
+		collectedInfo.back().results.swap(results);
+	}
+	watcher->Wake();
+}
+
+// Record the state the workers collected.  An entry that changed before its
+// state arrived might already show the change in its state, so make it copy
+// its newer file.
+void SyncEngine::ApplyCollectedInfo() {
+	std::vector<Collected> collected;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		collected.swap(collectedInfo);
+	}
+	std::vector<size_t> dirtyIndices;
+	for(auto const& batch : collected) {
+		for(auto const& result : batch.results) {
+			size_t i = MapIndex(batch.generation, result.index);
+			if(i == std::string::npos) {
+				continue;
+			}
+			snapshot->table.SetInfo(i, result.side, result.found ? &result.info : nullptr);
+			if(--schedules[i].collectingCount == 0 && schedules[i].isDirty) {
+				snapshot->table.ForgetNewerTime(i);
+				if(enabled) {
+					dirtyIndices.push_back(i);
+				}
+			}
+		}
+		FinishTask(batch.generation);
+	}
+	DispatchAll(dirtyIndices);
+}
+
+// Synchronize each entry affected by the events once.  Remember when each
+// entry first changed to measure how long until its copy lands.
+void SyncEngine::Synchronize(std::vector<Watcher::Event> const& events, std::vector<Coalescer::Clock::time_point> const& changeTimes) {
+	if(!snapshot) {
+		return;
+	}
+	EntryIndex const& index = snapshot->index;
+	std::vector<size_t> indices;
+	std::vector<EntryIndex::TreeChange> changes;
+	auto noteChange = [this](size_t i, Coalescer::Clock::time_point time) {
+		Coalescer::Clock::time_point& changeTime = schedules[i].changeTime;
+		if(changeTime == Coalescer::Clock::time_point() || time < changeTime) {
+			changeTime = time;
+		}
+	};
+	for(size_t k = 0; k < events.size(); ++k) {
+		size_t indexCount = indices.size(), changeCount = changes.size();
+		index.Find(events[k], indices);
+		index.FindTrees(events[k], changes);
+		for(size_t j = indexCount; j < indices.size(); ++j) {
+			noteChange(indices[j], changeTimes[k]);
+		}
+		for(size_t j = changeCount; j < changes.size(); ++j) {
+			noteChange(changes[j].index, changeTimes[k]);
+		}
+	}
+	for(auto const& change : changes) {
+		treeChanges[change.index].insert(change.relativePath);
+		indices.push_back(change.index);
+	}
+	std::sort(indices.begin(), indices.end());
+	indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+	metrics.Add(Metrics::EntriesScanned, indices.size());
+	std::vector<size_t> readyIndices;
+	for(size_t i : indices) {
+		if(schedules[i].isBusy || !IsLive(i)) {
+			schedules[i].isDirty = true;
+			if(schedules[i].cancellation) {
+				*schedules[i].cancellation = true;
+			}
+		} else {
+			readyIndices.push_back(i);
+		}
+	}
+	DispatchAll(readyIndices);
+}
+
+// Dispatch entries, giving the one-way file entries that share a main file
+// to one worker so it reads the file once for all of them.
+void SyncEngine::DispatchAll(std::vector<size_t> const& indices) {
+	EntryTable const& table = snapshot->table;
+	std::map<tstring, std::vector<size_t>> groups;
+	for(size_t i : indices) {
+		if(table.IsTree(i) || table.IsTwoWay(i)) {
+			Dispatch(i);
+		} else {
+			groups[FileSystem::GetKey(table.get_Path1(i))].push_back(i);
+		}
+	}
+	for(auto const& pair : groups) {
+		if(pair.second.size() == 1) {
+			Dispatch(pair.second.front());
+		} else {
+			DispatchGroup(pair.second);
+		}
+	}
+}
+
+void SyncEngine::MarkBusy(size_t i) {
+	schedules[i].isBusy = true;
+	schedules[i].isDirty = false;
+	schedules[i].busyChangeTime = schedules[i].changeTime;
+	schedules[i].changeTime = Coalescer::Clock::time_point();
+	StartTask(snapshot->generation);
+}
+
+void SyncEngine::Dispatch(size_t i) {
+	MarkBusy(i);
+	EntryTable const& table = snapshot->table;
+	std::vector<FileSystem::Device> devices;
+	devices.push_back(table.get_Device1(i));
+	devices.push_back(table.get_Device2(i));
+
+	// Give a tree its changed paths.  Comparing the whole tree covers the
+	// rest.
+	std::vector<tstring> relativePaths;
+	auto it = treeChanges.find(i);
+	if(it != treeChanges.end()) {
+		if(it->second.count(tstring()) != 0) {
+			relativePaths.push_back(tstring());
+		} else {
+			relativePaths.assign(it->second.begin(), it->second.end());
+		}
+		treeChanges.erase(it);
+	}
+	if(table.IsTree(i)) {
+		// A tree copies many files, so a change to one does not stop the
+		// others.
+		schedules[i].cancellation.reset();
+	} else {
+		schedules[i].cancellation = std::make_shared<std::atomic<bool>>(false);
+	}
+	pool.Submit(std::bind(&SyncEngine::Execute, this, SnapshotPointer(snapshot), i, table.GetState(i), relativePaths, schedules[i].cancellation), devices);
+}
+
+void SyncEngine::DispatchGroup(std::vector<size_t> const& indices) {
+	EntryTable const& table = snapshot->table;
+	auto cancellation = std::make_shared<std::atomic<bool>>(false);
+	std::vector<EntryTable::State> states;
+	std::vector<FileSystem::Device> devices(1, table.get_Device1(indices.front()));
+	for(size_t i : indices) {
+		MarkBusy(i);
+		schedules[i].cancellation = cancellation;
+		states.push_back(table.GetState(i));
+		devices.push_back(table.get_Device2(i));
+	}
+	std::sort(devices.begin(), devices.end());
+	devices.erase(std::unique(devices.begin(), devices.end()), devices.end());
+	pool.Submit(std::bind(&SyncEngine::ExecuteGroup, this, SnapshotPointer(snapshot), indices, states, cancellation), devices);
+}
+
+// Synchronize an entry on a worker thread and tell the engine thread.  The
+// task holds its snapshot, which lives until the last task using it ends.
+void SyncEngine::Execute(SnapshotPointer const& taskSnapshot, size_t i, EntryTable::State state, std::vector<tstring> const& relativePaths,
+	std::shared_ptr<std::atomic<bool>> const& cancellation) {
+	auto startTime = Coalescer::Clock::now();
+	++synchronizationCount;
+	EntryTable const& table = taskSnapshot->table;
+	Finished finished = { taskSnapshot->generation, i, state, std::vector<tstring>(), std::vector<tstring>(), 0 };
+	if(table.IsTree(i)) {
+		finished.copyCount = table.SynchronizeTree(i, relativePaths, copier, walker, finished.folderPaths, finished.deferredPaths);
+	} else if(table.Synchronize(i, finished.state, copier, finished.deferredPaths, cancellation.get())) {
+		finished.copyCount = 1;
+	}
+	copyCount += finished.copyCount;
+	metrics.Increment(Metrics::Synchronizations);
+	metrics.Record(Metrics::Synchronization, Coalescer::Clock::now() - startTime);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		finishedEntries.push_back(finished);
+	}
+	watcher->Wake();
+}
+
+// Synchronize entries sharing a main file on a worker thread and tell the
+// engine thread.  They finish together.
+void SyncEngine::ExecuteGroup(SnapshotPointer const& taskSnapshot, std::vector<size_t> const& indices, std::vector<EntryTable::State> states,
+	std::shared_ptr<std::atomic<bool>> const& cancellation) {
+	auto startTime = Coalescer::Clock::now();
+	++synchronizationCount;
+	std::vector<tstring> deferredPaths;
+	std::vector<bool> copied;
+	taskSnapshot->table.SynchronizeGroup(indices, states, copier, deferredPaths, cancellation.get(), copied);
+	std::vector<Finished> finished;
+	for(size_t k = 0; k < indices.size(); ++k) {
+		Finished item = { taskSnapshot->generation, indices[k], states[k], std::vector<tstring>(), std::vector<tstring>(), copied[k] ? 1u : 0u };
+		if(k == 0) {
+			item.deferredPaths.swap(deferredPaths);
+		}
+		copyCount += item.copyCount;
+		finished.push_back(std::move(item));
+	}
+	metrics.Increment(Metrics::Synchronizations);
+	metrics.Record(Metrics::Synchronization, Coalescer::Clock::now() - startTime);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		finishedEntries.insert(finishedEntries.end(), finished.begin(), finished.end());
+	}
+	watcher->Wake();
+}
+
+SyncEngine::Statistics SyncEngine::get_Statistics() const {
+	unsigned long long eventCount = coalescer.get_EventCount();
+	Statistics statistics = { eventCount, eventCount - coalescer.get_ReleaseCount(), synchronizationCount, copyCount };
+	return statistics;
+}
+
+void SyncEngine::Run() {
+	for(;;) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if(stopping) {
+				return;
+			}
+		}
+		ApplyFinishedEntries();
+		ApplyCollectedInfo();
+		ApplyPendingEntries();
+		ApplyPolledFolders();
+		PollDueFolders();
+
+		// Wait for a signal, a folder change, a held change to be ready, or a
+		// folder to poll.
+		Coalescer::Clock::time_point now = Coalescer::Clock::now();
+		int timeout = coalescer.GetTimeout(now), pollTimeout = poller.GetTimeout(now);
+		if(timeout == Watcher::Infinite || (pollTimeout != Watcher::Infinite && pollTimeout < timeout)) {
+			timeout = pollTimeout;
+		}
+		std::vector<Watcher::Event> events;
+		Coalescer::Clock::time_point waitTime = now;
+		Watcher::Result result = watcher->Wait(events, timeout);
+		now = Coalescer::Clock::now();
+		metrics.Increment(Metrics::Wakeups);
+		if(result == Watcher::Changed && enabled) {
+			metrics.Add(Metrics::Events, events.size());
+			AddEvents(events, now);
+		} else if(result == Watcher::Failed) {
+			// Avoid spinning if the watcher cannot wait.
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+		}
+		if(result == Watcher::Changed || result == Watcher::TimedOut) {
+			// The wait read all events queued before it began.
+			ExpireEchoes(waitTime);
+		}
+		events.clear();
+		std::vector<Coalescer::Clock::time_point> changeTimes;
+		coalescer.TakeReady(now, events, changeTimes);
+		if(!events.empty() && enabled) {
+			Synchronize(events, changeTimes);
+		}
+	}
+}
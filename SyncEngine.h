@@ -0,0 +1,204 @@
+#pragma once
+
+#include "Coalescer.h"
+#include "Copier.h"
+#include "EchoFilter.h"
+#include "Entry.h"
+#include "EntryIndex.h"
+#include "EntryTable.h"
+#include "Metrics.h"
+#include "Poller.h"
+#include "Watcher.h"
+#include "WorkerPool.h"
+
+// The engine owns a thread that watches the folders of its entries and
+// hands the entries whose files change to a pool of copy workers.  The
+// engine thread itself never touches the files of an entry.
+class SyncEngine
+{
+public:
+	SyncEngine();
+	~SyncEngine();
+	void Start(std::vector<Entry> const& entries);
+	void Stop();
+
+	// Replace the entries.  Entries for the same files keep their state,
+	// and their synchronizations in progress continue.
+	void SetEntries(std::vector<Entry> const& entries);
+	void Enable(bool value) { enabled = value; }
+
+	// Set how long a file must be quiet before synchronizing it and how long
+	// a file that keeps changing waits at most.  Call this before Start.
+	void ConfigureCoalescing(Coalescer::Clock::duration quietTime, Coalescer::Clock::duration maximumDelay) { coalescer.Configure(quietTime, maximumDelay); }
+
+	// Set the number of copy workers, zero for one per processor, and the
+	// number of concurrent copies for each non-rotational device.  Call this
+	// before Start.
+	void ConfigureWorkers(unsigned workerCount, unsigned deviceLimit) { this->workerCount = workerCount; pool.SetDefaultLimit(deviceLimit); }
+
+	// Give the I/O of the copy workers the lowest priority so other
+	// processes' I/O goes first.  Call this before Start.
+	void ConfigurePriority(bool isBackground) { pool.SetBackground(isBackground); }
+
+	// Set the shortest and longest intervals between listings of folders
+	// whose file systems do not report changes.  Call this before Start.
+	void ConfigurePolling(Poller::Clock::duration minimumInterval, Poller::Clock::duration maximumInterval) { poller.Configure(minimumInterval, maximumInterval); }
+
+	// Set how the workers copy files.  Call this before Start.
+	void ConfigureCopying(Copier::Options const& options) { copier.Configure(options); }
+
+	Copier::Statistics get_CopyStatistics() const { return copier.get_Statistics(); }
+	Metrics const& get_Metrics() const { return metrics; }
+
+	struct Statistics
+	{
+		unsigned long long eventCount, coalescedEventCount, synchronizationCount, copyCount;
+	};
+	Statistics get_Statistics() const;
+
+private:
+	// A snapshot is an immutable version of the entries.  SetEntries builds
+	// it on the calling thread and the engine thread publishes it by
+	// swapping a pointer.  Each worker holds the snapshot it started with,
+	// so edits and synchronizations never wait for each other.  The engine
+	// thread alone owns the state arrays of the current snapshot's table.
+	struct Snapshot
+	{
+		unsigned generation;
+		EntryTable table;
+		EntryIndex index;
+		std::set<tstring> folderPaths;
+	};
+	typedef std::shared_ptr<Snapshot const> SnapshotPointer;
+
+	// These are the scheduling states of an entry.  A worker synchronizes a
+	// copy of the entry's state while it is busy.
+	struct Schedule
+	{
+		bool isBusy, isDirty;
+
+		// This is the number of files of the entry whose state a worker is
+		// still collecting.  The entry is live, and synchronizes, only after
+		// that.
+		unsigned char collectingCount;
+
+		// These are the times of the first pending change and of the first
+		// change the worker is synchronizing, or zero.
+		Coalescer::Clock::time_point changeTime, busyChangeTime;
+
+		// A newer change of a file entry sets this to stop the worker's copy
+		// so the next one copies the newer contents.
+		std::shared_ptr<std::atomic<bool>> cancellation;
+	};
+
+	// A worker collects the state of the files of the new entries in one
+	// folder at a time.  The side is one or two for the first or second file
+	// of the entry.
+	struct InfoRequest
+	{
+		size_t index;
+		unsigned side;
+		tstring name;
+	};
+	struct InfoResult
+	{
+		size_t index;
+		unsigned side;
+		bool found;
+		FileSystem::Info info;
+	};
+	struct Collected
+	{
+		unsigned generation;
+		std::vector<InfoResult> results;
+	};
+
+	// A worker lists a polled folder.
+	struct Polled
+	{
+		tstring folderPath;
+		std::vector<FileSystem::Item> items;
+		bool isListed;
+
+		// This is set if the folder's file system was determined, and
+		// whether it reports changes.  A folder that does is not listed.
+		bool isClassified, hasChangeNotifications;
+	};
+
+	// A worker reports the new state of its entry, the folders it found in a
+	// tree, the files it did not copy because they were still being
+	// written, and the number of files it copied when it finishes.  The
+	// index is in the snapshot of the generation.
+	struct Finished
+	{
+		unsigned generation;
+		size_t index;
+		EntryTable::State state;
+		std::vector<tstring> folderPaths, deferredPaths;
+		unsigned copyCount;
+	};
+
+	std::unique_ptr<Watcher> watcher;
+	std::thread thread;
+	std::mutex mutex;
+	std::shared_ptr<Snapshot> snapshot;
+	std::vector<Schedule> schedules;
+	std::map<size_t, std::set<tstring>> treeChanges;
+
+	// These are the folders to watch: those of the snapshot and those the
+	// workers found in trees.
+	std::set<tstring> folderPaths, treeFolderPaths;
+
+	// A task refers to an entry by its index in the snapshot it started
+	// with.  These map the indices of each generation with tasks in progress
+	// to the next one, or to npos for removed entries.
+	std::map<unsigned, std::vector<size_t>> forwardIndices;
+	std::map<unsigned, size_t> taskCounts;
+	TreeWalker walker;
+	Coalescer coalescer;
+	Poller poller;
+	EchoFilter echoes;
+	WorkerPool pool;
+	Copier copier;
+	Metrics metrics;
+	unsigned workerCount;
+	std::atomic<unsigned long long> synchronizationCount, copyCount;
+	std::atomic<bool> enabled;
+
+	// The mutex protects these.
+	std::shared_ptr<Snapshot> pendingSnapshot;
+	unsigned nextGeneration;
+	std::vector<Finished> finishedEntries;
+	std::vector<Collected> collectedInfo;
+	std::vector<Polled> polledFolders;
+	bool stopping;
+
+	void Run();
+	void ApplyPendingEntries();
+	void ApplyFinishedEntries();
+	void ApplyCollectedInfo();
+	void CollectInfo(std::vector<size_t> const& indices);
+	void Collect(unsigned generation, tstring const& folderPath, std::vector<InfoRequest> const& requests);
+	bool IsLive(size_t i) const { return schedules[i].collectingCount == 0; }
+	void Synchronize(std::vector<Watcher::Event> const& events, std::vector<Coalescer::Clock::time_point> const& changeTimes);
+	void DispatchAll(std::vector<size_t> const& indices);
+	void Dispatch(size_t i);
+	void DispatchGroup(std::vector<size_t> const& indices);
+	void MarkBusy(size_t i);
+	void Execute(SnapshotPointer const& snapshot, size_t i, EntryTable::State state, std::vector<tstring> const& relativePaths,
+		std::shared_ptr<std::atomic<bool>> const& cancellation);
+	void ExecuteGroup(SnapshotPointer const& snapshot, std::vector<size_t> const& indices, std::vector<EntryTable::State> states,
+		std::shared_ptr<std::atomic<bool>> const& cancellation);
+	void WatchFolders();
+	void PollDueFolders();
+	void Poll(tstring const& folderPath, bool isClassifying);
+	void ApplyPolledFolders();
+	void AddEvents(std::vector<Watcher::Event> const& events, Coalescer::Clock::time_point now);
+	void ExpireEchoes(EchoFilter::Clock::time_point time);
+	void StartTask(unsigned generation);
+	void FinishTask(unsigned generation);
+	size_t MapIndex(unsigned generation, size_t i) const;
+
+	SyncEngine(SyncEngine const&); // undefined
+	SyncEngine& operator=(SyncEngine const&); // undefined
+};
@@ -0,0 +1,33 @@
+#include "stdafx.h"
+#include "Throttle.h"
+
+void Throttle::Configure(unsigned long long bytesPerSecond, unsigned long long operationsPerSecond) {
+	std::lock_guard<std::mutex> lock(mutex);
+	byteRate = static_cast<double>(bytesPerSecond);
+	operationRate = static_cast<double>(operationsPerSecond);
+	bytes = byteRate;
+	operations = operationRate;
+	lastTime = Clock::now();
+}
+
+// Refill a bucket for the elapsed seconds, take the amount, and get the
+// seconds until it is out of debt.
+static double Drain(double& balance, double rate, double seconds, double amount) {
+	if(rate <= 0) {
+		return 0;
+	}
+	balance = std::min(balance + rate * seconds, rate) - amount;
+	return balance < 0 ? -balance / rate : 0;
+}
+
+Throttle::Clock::duration Throttle::Take(unsigned long long byteCount, unsigned long long operationCount, Clock::time_point now) {
+	if(!IsEnabled()) {
+		return Clock::duration::zero();
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	double seconds = now > lastTime ? std::chrono::duration<double>(now - lastTime).count() : 0;
+	lastTime = std::max(lastTime, now);
+	double wait = std::max(Drain(bytes, byteRate, seconds, static_cast<double>(byteCount)),
+		Drain(operations, operationRate, seconds, static_cast<double>(operationCount)));
+	return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(wait));
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+// A throttle limits the rate of I/O with a token bucket for bytes and one
+// for operations.  Each bucket fills at its rate and holds at most a
+// second's worth, so short bursts pass at full speed.  Callers take the
+// tokens of the I/O they did and wait while a bucket is in debt, so
+// sustained I/O from any number of threads stays at the limits.
+class Throttle
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	Throttle() : byteRate(), operationRate(), bytes(), operations() {}
+
+	// Set the limits per second.  Zero disables a limit.
+	void Configure(unsigned long long bytesPerSecond, unsigned long long operationsPerSecond);
+	bool IsEnabled() const { return byteRate > 0 || operationRate > 0; }
+
+	// Take the tokens of some I/O and get how long the caller must wait
+	// before its next I/O.  Other threads may call this concurrently.
+	Clock::duration Take(unsigned long long byteCount, unsigned long long operationCount, Clock::time_point now);
+
+private:
+	double byteRate, operationRate;
+
+	// The mutex protects these.  A negative balance is a debt.
+	std::mutex mutex;
+	double bytes, operations;
+	Clock::time_point lastTime;
+
+	Throttle(Throttle const&); // undefined
+	Throttle& operator=(Throttle const&); // undefined
+};
@@ -0,0 +1,117 @@
+#include "stdafx.h"
+#include "TreeWalker.h"
+
+TreeWalker::TreeWalker(unsigned threadCount) : threadCount(threadCount), stopping(false) {
+	if(this->threadCount == 0) {
+		this->threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+}
+
+TreeWalker::~TreeWalker() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	condition.notify_all();
+	for(auto& thread : threads) {
+		thread.join();
+	}
+}
+
+tstring TreeWalker::Resolve(tstring const& rootPath, tstring const& relativePath) {
+	return relativePath.empty() ? rootPath : FileSystem::Combine(rootPath, relativePath);
+}
+
+void TreeWalker::Compare(tstring const& rootPath1, tstring const& rootPath2, tstring const& relativePath, bool isTwoWay,
+	std::vector<tstring>& filePaths, std::vector<tstring>& folderPaths) {
+	Walk walk = { rootPath1, rootPath2, isTwoWay, std::deque<tstring>(1, relativePath), 0, filePaths, folderPaths };
+	std::unique_lock<std::mutex> lock(mutex);
+	if(threads.empty()) {
+		for(unsigned i = 1; i < threadCount; ++i) {
+			threads.push_back(std::thread(&TreeWalker::Help, this));
+		}
+	}
+	walks.push_back(&walk);
+	auto it = std::prev(walks.end());
+	condition.notify_all();
+
+	// List folders of this walk until it is over.  No helper refers to it
+	// then, so it can go.
+	for(;;) {
+		condition.wait(lock, [&walk] { return !walk.queue.empty() || walk.activeCount == 0; });
+		if(walk.queue.empty()) {
+			break;
+		}
+		ListNext(walk, lock);
+	}
+	walks.erase(it);
+}
+
+// List folders of any walk with folders to list until the walker stops.
+void TreeWalker::Help() {
+	std::unique_lock<std::mutex> lock(mutex);
+	for(;;) {
+		auto it = walks.end();
+		condition.wait(lock, [this, &it] {
+			it = std::find_if(walks.begin(), walks.end(), [](Walk const* walk) { return !walk->queue.empty(); });
+			return stopping || it != walks.end();
+		});
+		if(stopping) {
+			return;
+		}
+		ListNext(**it, lock);
+	}
+}
+
+// List the next folder of a walk on both sides and match their items by
+// name.  The caller holds the lock, which this releases while listing.
+void TreeWalker::ListNext(Walk& walk, std::unique_lock<std::mutex>& lock) {
+	tstring folderPath = walk.queue.front();
+	walk.queue.pop_front();
+	++walk.activeCount;
+	lock.unlock();
+
+	std::vector<FileSystem::Item> items1, items2;
+	std::vector<tstring> foundFilePaths, foundFolderPaths;
+	FileSystem::ListFolder(Resolve(walk.rootPath1, folderPath), items1);
+	FileSystem::ListFolder(Resolve(walk.rootPath2, folderPath), items2);
+	std::map<tstring, FileSystem::Item const*> others;
+	for(auto const& item : items2) {
+		if(!FileSystem::IsTemporary(item.name)) {
+			others[item.name] = &item;
+		}
+	}
+	for(auto const& item : items1) {
+		if(FileSystem::IsTemporary(item.name)) {
+			// Skip the files of copies in progress.
+			continue;
+		}
+		tstring path = Resolve(folderPath, item.name);
+		auto it = others.find(item.name);
+		FileSystem::Item const* other = it == others.end() ? nullptr : it->second;
+		if(other != nullptr) {
+			others.erase(it);
+		}
+		if(item.info.isFolder) {
+			foundFolderPaths.push_back(path);
+		} else if(other == nullptr || other->info.isFolder || other->info.lastWriteTime != item.info.lastWriteTime) {
+			foundFilePaths.push_back(path);
+		}
+	}
+	if(walk.isTwoWay) {
+		for(auto const& pair : others) {
+			if(pair.second->info.isFolder) {
+				foundFolderPaths.push_back(Resolve(folderPath, pair.first));
+			} else {
+				foundFilePaths.push_back(Resolve(folderPath, pair.first));
+			}
+		}
+	}
+
+	lock.lock();
+	--walk.activeCount;
+	walk.queue.insert(walk.queue.end(), foundFolderPaths.begin(), foundFolderPaths.end());
+	walk.folderPaths.push_back(folderPath);
+	walk.filePaths.insert(walk.filePaths.end(), foundFilePaths.begin(), foundFilePaths.end());
+	condition.notify_all();
+}
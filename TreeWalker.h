@@ -0,0 +1,58 @@
+#pragma once
+
+#include "FileSystem.h"
+
+// A tree walker compares two folder trees to find the files that differ.
+// Several threads list folders at once since listing is mostly waiting on
+// the file system.  The walker starts its helper threads at its first
+// comparison and shares them among concurrent comparisons, whose callers
+// list folders of their own trees as well.
+class TreeWalker
+{
+public:
+	// A thread count of zero uses the number of processors.  It counts a
+	// caller and the shared helpers.
+	explicit TreeWalker(unsigned threadCount);
+	~TreeWalker();
+
+	// Compare the subtrees at a relative path of two trees.  Find the files
+	// of the first tree whose counterparts are missing or have other last
+	// write times and, for a two-way comparison, the files only in the
+	// second tree.  Also find the folders of the compared trees.  Return
+	// the relative paths.
+	void Compare(tstring const& rootPath1, tstring const& rootPath2, tstring const& relativePath, bool isTwoWay,
+		std::vector<tstring>& filePaths, std::vector<tstring>& folderPaths);
+
+	// Combine a root path and a relative path, which might be empty.
+	static tstring Resolve(tstring const& rootPath, tstring const& relativePath);
+
+private:
+	// A walk is a comparison in progress.  Its queue holds the relative
+	// paths of the folders to list.  It is over when its queue is empty and
+	// no thread is listing one of its folders.
+	struct Walk
+	{
+		tstring const& rootPath1;
+		tstring const& rootPath2;
+		bool isTwoWay;
+		std::deque<tstring> queue;
+		unsigned activeCount;
+		std::vector<tstring>& filePaths;
+		std::vector<tstring>& folderPaths;
+	};
+
+	unsigned threadCount;
+	std::vector<std::thread> threads;
+
+	// The mutex protects these.
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::list<Walk*> walks;
+	bool stopping;
+
+	void ListNext(Walk& walk, std::unique_lock<std::mutex>& lock);
+	void Help();
+
+	TreeWalker(TreeWalker const&); // undefined
+	TreeWalker& operator=(TreeWalker const&); // undefined
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+// A watcher waits for changes in a set of folders.  Each platform provides
+// its own implementation through Create.  A folder stays watched from the
+// SetFolders call that adds it until the one that removes it so no change
+// goes unreported between waits.
+class Watcher
+{
+public:
+	enum Result { Changed, Woken, TimedOut, Failed };
+	enum Action { Added, Removed, Modified, RenamedFrom, RenamedTo, Overflow };
+
+	// An Overflow event means the platform dropped events for the folder, or
+	// for all folders if the folder path is empty.  It has no name.
+	struct Event
+	{
+		tstring folderPath;
+		tstring name;
+		Action action;
+	};
+
+	virtual ~Watcher() {}
+
+	// Add and remove watches so the watched folders match the given set.
+	// Folders in both sets keep their watches.
+	virtual void SetFolders(std::set<tstring> const& folderPaths) = 0;
+
+	// Wait up to timeout milliseconds, or forever for Infinite, for a change
+	// in any watched folder or a call to Wake.  For Changed, append the
+	// changes to events.
+	virtual Result Wait(std::vector<Event>& events, int timeout) = 0;
+	static int const Infinite = -1;
+
+	// Release a thread waiting in Wait.  Other threads may call this.
+	virtual void Wake() = 0;
+
+	// Get the number of folders with working watches.
+	virtual size_t get_FolderCount() const = 0;
+
+	static std::unique_ptr<Watcher> Create();
+};
@@ -0,0 +1,113 @@
+#include "stdafx.h"
+#include "Benchmark.h"
+#include "EntryIndex.h"
+#include "Watcher.h"
+#include <random>
+
+// This measures the time from writing a file to finding its entry through
+// the watcher and the entry index for increasing numbers of watched folders.
+
+using Benchmark::Clock;
+
+static bool WriteFile(tstring const& path, char const* text) {
+	return Benchmark::WriteFile(path, text, strlen(text));
+}
+
+static bool Measure(tstring const& rootPath, size_t folderCount, size_t sampleCount) {
+	// Create the folders and an entry for each.
+	std::vector<Entry> entries(folderCount);
+	std::set<tstring> folderPaths;
+	for(size_t i = 0; i < folderCount; ++i) {
+		tstring folderPath = FileSystem::Combine(rootPath, std::to_string(folderCount) + "-" + std::to_string(i));
+		tstring path1 = FileSystem::Combine(folderPath, "main"), path2 = FileSystem::Combine(folderPath, "backup");
+		if(mkdir(folderPath.c_str(), 0777) != 0 || !WriteFile(path1, "main") || !WriteFile(path2, "backup")) {
+			fprintf(stderr, "cannot create %s\n", folderPath.c_str());
+			return false;
+		}
+		entries[i].CreateFromString(path1 + "\t" + path2 + "\t0");
+		folderPaths.insert(folderPath);
+	}
+	EntryIndex index;
+	index.Build(entries);
+
+	auto watcher = Watcher::Create();
+	Clock::time_point start = Clock::now();
+	watcher->SetFolders(folderPaths);
+	double setupTime = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+	// Write a random main file and wait for its entry.
+	std::mt19937 random(static_cast<unsigned>(folderCount));
+	std::vector<double> latencies;
+	std::vector<Watcher::Event> events;
+	std::vector<size_t> indices;
+	unsigned lostCount = 0;
+	for(size_t sample = 0; sample < sampleCount; ++sample) {
+		size_t target = random() % folderCount;
+		start = Clock::now();
+		if(!WriteFile(entries[target].get_Path1(), "changed")) {
+			return false;
+		}
+		bool found = false;
+		while(!found) {
+			events.clear();
+			Watcher::Result result = watcher->Wait(events, 100);
+			if(result == Watcher::TimedOut) {
+				// The folder is probably beyond the system's watch limit.
+				++lostCount;
+				break;
+			} else if(result != Watcher::Changed) {
+				fprintf(stderr, "watcher failed\n");
+				return false;
+			}
+			for(auto const& event : events) {
+				indices.clear();
+				index.Find(event, indices);
+				found = found || std::find(indices.begin(), indices.end(), target) != indices.end();
+			}
+		}
+		if(found) {
+			latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+		}
+	}
+	std::sort(latencies.begin(), latencies.end());
+	printf("%8u %8u %10.1f %8.1f %8.1f %8.1f %8.1f %6u\n", (unsigned)folderCount, (unsigned)watcher->get_FolderCount(), setupTime,
+		Benchmark::GetPercentile(latencies, 0.5), Benchmark::GetPercentile(latencies, 0.9), Benchmark::GetPercentile(latencies, 0.99), latencies.empty() ? 0 : latencies.back(), lostCount);
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	std::vector<size_t> folderCounts = { 10, 100, 1000, 10000, 50000 };
+	size_t sampleCount = 1000;
+	int option;
+	while((option = getopt(argc, argv, "n:s:")) != -1) {
+		switch(option) {
+		case 'n':
+			folderCounts.assign(1, strtoul(optarg, nullptr, 10));
+			break;
+		case 's':
+			sampleCount = strtoul(optarg, nullptr, 10);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n folder-count] [-s sample-count] [folder]\n", argv[0]);
+			return 2;
+		}
+	}
+	tstring parentPath = optind < argc ? argv[optind] : "/tmp";
+	tstring rootPath;
+	if(!Benchmark::MakeTemporaryFolder(parentPath, "WatcherBenchmark", rootPath)) {
+		return 1;
+	}
+
+	printf("# latencies in microseconds from write to dispatch\n");
+	printf("# %6s %8s %10s %8s %8s %8s %8s %6s\n", "folders", "watched", "setup(ms)", "p50", "p90", "p99", "max", "lost");
+	setvbuf(stdout, nullptr, _IOLBF, 0);
+	bool succeeded = true;
+	for(size_t folderCount : folderCounts) {
+		if(folderCount > 0 && !Measure(rootPath, folderCount, sampleCount)) {
+			succeeded = false;
+			break;
+		}
+	}
+	Benchmark::RemoveFolder(rootPath);
+	return succeeded ? 0 : 1;
+}
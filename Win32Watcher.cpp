@@ -0,0 +1,191 @@
+#include "stdafx.h"
+#include "Watcher.h"
+
+namespace {
+	// This is an open folder with an outstanding ReadDirectoryChangesW call.
+	// Between calls, the system queues changes for the open folder handle so
+	// none are lost.
+	struct Folder
+	{
+		tstring path;
+		HANDLE directory;
+		OVERLAPPED overlapped;
+		DWORD buffer[16384 / sizeof(DWORD)];
+
+		Folder(tstring const& path) : path(path), directory(INVALID_HANDLE_VALUE), overlapped() {}
+		~Folder() { Close(); }
+		bool Open(HANDLE port);
+		bool Read();
+		void Close();
+	};
+
+	// All folders complete their reads on one I/O completion port so the
+	// number of folders is not limited by WaitForMultipleObjects.
+	class Win32Watcher : public Watcher
+	{
+	public:
+		Win32Watcher() : port(CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1)) {}
+		~Win32Watcher();
+		void SetFolders(std::set<tstring> const& folderPaths) override;
+		Result Wait(std::vector<Event>& events, int timeout) override;
+		void Wake() override { PostQueuedCompletionStatus(port, 0, 0, NULL); }
+		size_t get_FolderCount() const override { return folders.size(); }
+
+	private:
+		std::map<tstring, std::unique_ptr<Folder>> folders;
+
+		// These are closed folders whose reads have not yet completed.  The
+		// system writes into their buffers until then.
+		std::map<Folder*, std::unique_ptr<Folder>> closingFolders;
+		HANDLE port;
+	};
+}
+
+// Report folders created, removed, and renamed as well as files so tree
+// entries mirror and watch new folders, as the inotify watcher does.  Their
+// actions translate as those of files do.
+static DWORD const notifyFilter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE
+	| FILE_NOTIFY_CHANGE_SIZE;
+
+bool Folder::Open(HANDLE port) {
+	directory = CreateFile(path.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+	return directory != INVALID_HANDLE_VALUE && CreateIoCompletionPort(directory, port, reinterpret_cast<ULONG_PTR>(this), 0) != NULL && Read();
+}
+
+bool Folder::Read() {
+	return !!ReadDirectoryChangesW(directory, buffer, sizeof(buffer), FALSE, notifyFilter, NULL, &overlapped, NULL);
+}
+
+void Folder::Close() {
+	if(directory != INVALID_HANDLE_VALUE) {
+		CloseHandle(directory);
+		directory = INVALID_HANDLE_VALUE;
+	}
+}
+
+static Watcher::Action TranslateAction(DWORD action) {
+	switch(action) {
+	case FILE_ACTION_ADDED:
+		return Watcher::Added;
+	case FILE_ACTION_REMOVED:
+		return Watcher::Removed;
+	case FILE_ACTION_RENAMED_OLD_NAME:
+		return Watcher::RenamedFrom;
+	case FILE_ACTION_RENAMED_NEW_NAME:
+		return Watcher::RenamedTo;
+	default:
+		return Watcher::Modified;
+	}
+}
+
+static tstring GetName(FILE_NOTIFY_INFORMATION const* information) {
+	int length = information->FileNameLength / sizeof(WCHAR);
+#ifdef _UNICODE
+	return tstring(information->FileName, length);
+#else
+	int n = WideCharToMultiByte(CP_ACP, 0, information->FileName, length, NULL, 0, NULL, NULL);
+	tstring name(n, '\0');
+	WideCharToMultiByte(CP_ACP, 0, information->FileName, length, &name[0], n, NULL, NULL);
+	return name;
+#endif
+}
+
+Win32Watcher::~Win32Watcher() {
+	for(auto& pair : folders) {
+		pair.second->Close();
+		closingFolders[pair.second.get()] = std::move(pair.second);
+	}
+	folders.clear();
+
+	// Wait for the reads of the closed folders to complete.
+	while(!closingFolders.empty()) {
+		DWORD n;
+		ULONG_PTR key;
+		LPOVERLAPPED overlapped;
+		if(!GetQueuedCompletionStatus(port, &n, &key, &overlapped, INFINITE) && overlapped == NULL) {
+			break;
+		}
+		if(key != 0) {
+			closingFolders.erase(reinterpret_cast<Folder*>(key));
+		}
+	}
+	CloseHandle(port);
+}
+
+void Win32Watcher::SetFolders(std::set<tstring> const& folderPaths) {
+	// Close the folders not in the new set.
+	for(auto it = folders.begin(); it != folders.end();) {
+		if(folderPaths.find(it->first) == folderPaths.end()) {
+			it->second->Close();
+			closingFolders[it->second.get()] = std::move(it->second);
+			it = folders.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	// Open the folders not in the old set.  Retry folders that failed before
+	// since they might exist now.
+	for(auto const& folderPath : folderPaths) {
+		if(folders.find(folderPath) == folders.end()) {
+			std::unique_ptr<Folder> folder(new Folder(folderPath));
+			if(folder->Open(port)) {
+				folders[folderPath] = std::move(folder);
+			}
+		}
+	}
+}
+
+Watcher::Result Win32Watcher::Wait(std::vector<Event>& events, int timeout) {
+	for(;;) {
+		// Wait for a signal or a folder change.
+		DWORD n;
+		ULONG_PTR key;
+		LPOVERLAPPED overlapped;
+		BOOL succeeded = GetQueuedCompletionStatus(port, &n, &key, &overlapped, timeout == Infinite ? INFINITE : static_cast<DWORD>(timeout));
+		if(overlapped == NULL) {
+			if(succeeded) {
+				return Woken;
+			}
+			return GetLastError() == WAIT_TIMEOUT ? TimedOut : Failed;
+		}
+		Folder* folder = reinterpret_cast<Folder*>(key);
+		if(folder->directory == INVALID_HANDLE_VALUE) {
+			// This is the last read of a closed folder.  Free it.
+			closingFolders.erase(folder);
+			continue;
+		}
+		if(!succeeded) {
+			// The folder went away.  Forget it until SetFolders adds it again.
+			events.push_back(Event{ folder->path, tstring(), Overflow });
+			tstring folderPath = folder->path;
+			folders.erase(folderPath);
+			return Changed;
+		}
+
+		// Translate the changes and restart the read.
+		if(n == 0) {
+			// The buffer overflowed.
+			events.push_back(Event{ folder->path, tstring(), Overflow });
+		} else {
+			for(BYTE const* p = reinterpret_cast<BYTE const*>(folder->buffer);;) {
+				FILE_NOTIFY_INFORMATION const* information = reinterpret_cast<FILE_NOTIFY_INFORMATION const*>(p);
+				events.push_back(Event{ folder->path, GetName(information), TranslateAction(information->Action) });
+				if(information->NextEntryOffset == 0) {
+					break;
+				}
+				p += information->NextEntryOffset;
+			}
+		}
+		if(!folder->Read()) {
+			tstring folderPath = folder->path;
+			folders.erase(folderPath);
+		}
+		return Changed;
+	}
+}
+
+std::unique_ptr<Watcher> Watcher::Create() {
+	return std::unique_ptr<Watcher>(new Win32Watcher);
+}
@@ -0,0 +1,169 @@
+#include "stdafx.h"
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool() : queuedCount(), stopping(false), nextQueue(), isBackground(false), defaultLimit(4) {}
+
+WorkerPool::~WorkerPool() {
+	Stop();
+}
+
+void WorkerPool::Start(unsigned workerCount) {
+	ASSERT(threads.empty());
+	if(workerCount == 0) {
+		workerCount = std::max(1u, std::thread::hardware_concurrency());
+	}
+	stopping = false;
+	for(unsigned i = 0; i < workerCount; ++i) {
+		queues.emplace_back(new Queue);
+	}
+	for(unsigned i = 0; i < workerCount; ++i) {
+		threads.emplace_back(&WorkerPool::Run, this, i);
+	}
+}
+
+void WorkerPool::Stop() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	condition.notify_all();
+	for(auto& thread : threads) {
+		thread.join();
+	}
+	threads.clear();
+	queues.clear();
+	devices.clear();
+	queuedCount = 0;
+}
+
+void WorkerPool::SetLimit(FileSystem::Device device, unsigned limit) {
+	std::lock_guard<std::mutex> lock(mutex);
+	devices[device].limit = std::max(1u, limit);
+}
+
+void WorkerPool::Submit(Task const& task, std::vector<FileSystem::Device> const& devices) {
+	Item item = { task, devices };
+
+	// Count a device once even if both files are on it.
+	std::sort(item.devices.begin(), item.devices.end());
+	item.devices.erase(std::unique(item.devices.begin(), item.devices.end()), item.devices.end());
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		FileSystem::Device blockingDevice;
+		if(!TryAcquire(item.devices, blockingDevice)) {
+			this->devices[blockingDevice].blockedItems.push_back(std::move(item));
+			return;
+		}
+	}
+	Enqueue(std::move(item));
+}
+
+// Take a slot on every device or on none.  If none, get the first device at
+// its limit.  The caller holds the mutex.
+bool WorkerPool::TryAcquire(std::vector<FileSystem::Device> const& devices, FileSystem::Device& blockingDevice) {
+	for(auto device : devices) {
+		Device& value = this->devices[device];
+		if(value.limit == 0) {
+			value.limit = FileSystem::IsRotational(device) ? 1 : defaultLimit;
+		}
+		if(value.activeCount >= value.limit) {
+			blockingDevice = device;
+			return false;
+		}
+	}
+	for(auto device : devices) {
+		++this->devices[device].activeCount;
+	}
+	return true;
+}
+
+// Give back the device slots of a finished task and queue the blocked tasks
+// at the front of those devices' queues that can now run.  Move a task
+// still blocked by another device to that device's queue.
+void WorkerPool::Release(std::vector<FileSystem::Device> const& devices) {
+	std::vector<Item> readyItems;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for(auto device : devices) {
+			--this->devices[device].activeCount;
+		}
+		for(auto device : devices) {
+			std::deque<Item>& blockedItems = this->devices[device].blockedItems;
+			while(!blockedItems.empty()) {
+				FileSystem::Device blockingDevice;
+				if(TryAcquire(blockedItems.front().devices, blockingDevice)) {
+					readyItems.push_back(std::move(blockedItems.front()));
+				} else if(blockingDevice != device) {
+					this->devices[blockingDevice].blockedItems.push_back(std::move(blockedItems.front()));
+				} else {
+					break;
+				}
+				blockedItems.pop_front();
+			}
+		}
+	}
+	for(auto& item : readyItems) {
+		Enqueue(std::move(item));
+	}
+}
+
+// Distribute tasks among the workers' queues and wake one worker.
+void WorkerPool::Enqueue(Item&& item) {
+	size_t i;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		i = nextQueue++ % queues.size();
+	}
+	{
+		std::lock_guard<std::mutex> lock(queues[i]->mutex);
+		queues[i]->items.push_back(std::move(item));
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		++queuedCount;
+	}
+	condition.notify_one();
+}
+
+// Take from the front of this worker's queue or steal from the back of
+// another's.
+bool WorkerPool::TryTake(size_t workerIndex, Item& item) {
+	for(size_t n = 0; n < queues.size(); ++n) {
+		Queue& queue = *queues[(workerIndex + n) % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if(!queue.items.empty()) {
+			if(n == 0) {
+				item = std::move(queue.items.front());
+				queue.items.pop_front();
+			} else {
+				item = std::move(queue.items.back());
+				queue.items.pop_back();
+			}
+			--queuedCount;
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkerPool::Run(size_t workerIndex) {
+	if(isBackground) {
+		FileSystem::LowerIoPriority();
+	}
+	for(;;) {
+		Item item;
+		if(!TryTake(workerIndex, item)) {
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [this] { return stopping || queuedCount > 0; });
+			if(stopping) {
+				return;
+			}
+			continue;
+		}
+		if(stopping) {
+			return;
+		}
+		item.task();
+		Release(item.devices);
+	}
+}
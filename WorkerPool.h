@@ -0,0 +1,73 @@
+#pragma once
+
+#include "FileSystem.h"
+
+// A worker pool runs tasks on a fixed set of threads.  Each worker takes
+// tasks from the front of its own queue and steals from the back of the
+// others' when its own is empty.  Each task names the devices it uses and
+// waits outside the queues, in first-in first-out order on a device at its
+// concurrency limit, while any of them is at it.
+class WorkerPool
+{
+public:
+	typedef std::function<void()> Task;
+
+	WorkerPool();
+	~WorkerPool();
+
+	// Start the workers.  A count of zero uses the number of processors.
+	void Start(unsigned workerCount);
+
+	// Stop the workers after their current tasks, discarding queued ones.
+	void Stop();
+
+	// Set the number of concurrent tasks for a device.  Devices without a
+	// limit use one for rotational disks and defaultLimit for others.
+	void SetLimit(FileSystem::Device device, unsigned limit);
+	void SetDefaultLimit(unsigned limit) { defaultLimit = limit; }
+
+	// Give the I/O of the workers the lowest priority.  Call this before
+	// Start.
+	void SetBackground(bool value) { isBackground = value; }
+
+	void Submit(Task const& task, std::vector<FileSystem::Device> const& devices);
+
+private:
+	struct Item
+	{
+		Task task;
+		std::vector<FileSystem::Device> devices;
+	};
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Item> items;
+	};
+	struct Device
+	{
+		unsigned activeCount, limit;
+		std::deque<Item> blockedItems;
+	};
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::atomic<size_t> queuedCount;
+	std::atomic<bool> stopping;
+	size_t nextQueue;
+	bool isBackground;
+
+	// The mutex protects these.
+	std::map<FileSystem::Device, Device> devices;
+	unsigned defaultLimit;
+
+	bool TryAcquire(std::vector<FileSystem::Device> const& devices, FileSystem::Device& blockingDevice);
+	void Release(std::vector<FileSystem::Device> const& devices);
+	void Enqueue(Item&& item);
+	bool TryTake(size_t workerIndex, Item& item);
+	void Run(size_t workerIndex);
+
+	WorkerPool(WorkerPool const&); // undefined
+	WorkerPool& operator=(WorkerPool const&); // undefined
+};
@@ -12,24 +12,43 @@
 #ifndef STRICT
 #	define STRICT
 #endif
-#include "targetver.h"
+#ifdef _WIN32
+#	include "targetver.h"
 
 // Enable allocation tracking.
-#include <cstdlib>
-#define _CRT_MAP_ALLOC
+#	include <cstdlib>
+#	define _CRT_MAP_ALLOC
+#endif
 
 // Standard library include directives
-#pragma warning(push)
+#ifdef _MSC_VER
+#	pragma warning(push)
 #	pragma warning(disable: 4702)
+#endif
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <deque>
 #include <fstream>
 #include <functional>
 #include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
 #include <set>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
-#pragma warning(pop)
+#ifdef _MSC_VER
+#	pragma warning(pop)
+#endif
 
 #ifdef _UNICODE
 typedef std::wifstream tifstream;
@@ -49,6 +68,7 @@ typedef std::string tstring;
 typedef std::stringstream tstringstream;
 #endif
 
+#ifdef _WIN32
 // Windows Header Files:
 #include <windows.h>
 #include <windowsx.h>
@@ -250,3 +270,44 @@ private:
 	CCriticalSection(CCriticalSection const&); // undefined
 	CCriticalSection& operator=(CCriticalSection const&); // undefined
 };
+#else
+// POSIX Header Files
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <linux/ioprio.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+// These let the portable sources share the text conventions of the Windows
+// sources.  Outside of Windows, all text is narrow.
+typedef char TCHAR;
+#define _T(x) x
+
+#define ASSERT assert
+#ifdef NDEBUG
+#	define VERIFY(expr) ((void)(expr))
+#else
+#	define VERIFY assert
+#endif
+
+#ifndef _countof
+#	define _countof(array) (sizeof(array) / sizeof((array)[0]))
+#endif
+#endif